@@ -0,0 +1,284 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <cstdint>
+#include <getopt.h>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include "siftEngine.h"
+
+// External function to print help if needed
+void usage() {
+  std::cout << std::endl << "Usage: coincidence (-options) CCLfile1 CCLfile2 ..." << std::endl << std::endl;
+  std::cout << "     -p: Width of the period bins, as a fraction of the period (default = 0.001)" << std::endl;
+  std::cout << "     -d: Width of the DM bins (default = 5.0)" << std::endl;
+  std::cout << "     -n: Most beams a signal can be seen in and still be kept (default = 4)" << std::endl;
+  std::cout << "     -j: Number of threads to use to read the CCL files (default = number of cores)" << std::endl;
+  std::cout << "     -x: Suffix added to the name of each CCL file to make its output file name (default = .coinc)" << std::endl << std::endl;
+  std::cout << "Each CCL file is one beam. Candidates with a period and DM seen in more than -n beams are taken out, and every other" << std::endl;
+  std::cout << "line of each file is copied unchanged to its output file, ready for sift or strongSift. Candidates with a period that" << std::endl;
+  std::cout << "isn't a positive number, or a DM that isn't a number, are not binned and are copied unchanged." << std::endl << std::endl;
+}
+
+// One beam's CCL file, mapped into memory, with the lines that hold candidates
+struct beamFile {
+  const char *name;
+  const char *text;
+  size_t length;
+  bool readOK;
+  // The candidates, and where the line of each starts and ends (after its newline)
+  candidateList ccl;
+  std::vector<size_t> lineStarts, lineEnds;
+};
+
+// Map a CCL file into memory and find its candidates, one per line
+bool readBeamFile(beamFile &beam) {
+
+  struct stat fileStatus;
+  candidateList lineCandidates;
+  int fileDescriptor = open(beam.name, O_RDONLY);
+
+  beam.text = NULL;
+  beam.length = 0;
+  if (fileDescriptor < 0) {
+    return false;
+  }
+  if (fstat(fileDescriptor, &fileStatus) != 0) {
+    close(fileDescriptor);
+    return false;
+  }
+  beam.length = fileStatus.st_size;
+  if (beam.length > 0) {
+    void *mappedFile = mmap(NULL, beam.length, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+    if (mappedFile == MAP_FAILED) {
+      close(fileDescriptor);
+      return false;
+    }
+    beam.text = (const char*) mappedFile;
+  }
+  close(fileDescriptor);
+
+  // Lines that aren't candidates (headers, say) are left alone and copied to the output, as are candidates with a period or DM that
+  // can't be put in a bin (a period that isn't a positive number, or a DM that isn't a number)
+  for (size_t lineStart = 0; lineStart < beam.length; ) {
+    const char *newline = (const char*) memchr(beam.text + lineStart, '\n', beam.length - lineStart);
+    const size_t lineEnd = newline == NULL ? beam.length : newline - beam.text + 1;
+    lineCandidates.snr.clear();
+    lineCandidates.period.clear();
+    lineCandidates.dm.clear();
+    parseCCL(beam.text + lineStart, beam.text + lineEnd, lineCandidates);
+    if (lineCandidates.snr.size() == 1 && lineCandidates.period[0] > 0 && std::isfinite(lineCandidates.period[0]) && std::isfinite(lineCandidates.dm[0])) {
+      beam.ccl.snr.push_back(lineCandidates.snr[0]);
+      beam.ccl.period.push_back(lineCandidates.period[0]);
+      beam.ccl.dm.push_back(lineCandidates.dm[0]);
+      beam.lineStarts.push_back(lineStart);
+      beam.lineEnds.push_back(lineEnd);
+    }
+    lineStart = lineEnd;
+  }
+
+  return true;
+
+}
+
+// Number of the bin 'value' (in units of the bin width) is in, kept within the 32 bits a bin number has in a key
+inline int64_t binNumber(double value) {
+  return (int64_t) std::max((double) INT32_MIN, std::min((double) INT32_MAX, floor(value)));
+}
+
+// Key of the bin at (periodBin, dmBin)
+inline uint64_t binKey(int64_t periodBin, int64_t dmBin) {
+  return ((uint64_t) periodBin << 32) ^ ((uint64_t) dmBin & 0xffffffff);
+}
+
+/* -- coincidence ------------------------------------------------------------------------------------------------------------
+** Removes candidates seen in many beams from the CCLs of a multibeam observation, before they are sifted. A pulsar is only    |
+** seen in a beam or a few neighbouring beams, while RFI comes in through the sidelobes of most of them.                       |
+**                                                                                                                             |
+** Every candidate is put in a hash table of bins of log period and DM, which records the distinct beams seen in each bin. A   |
+** candidate is taken out if its bin and the neighbouring bins (so a signal on the edge of a bin is still counted together) are |
+** seen in more than -n beams. Each bin and each candidate are only looked at a few times, so this takes linear time however   |
+** many beams there are.                                                                                                       |
+--------------------------------------------------------------------------------------------------------------------------- */
+int main(int argc, char *argv[]) {
+
+  int arg, maxBeams = 4, numThreads = 0;
+  double periodBinWidth = 0.001, dmBinWidth = 5.0;
+  const char *suffix = ".coinc";
+  std::vector<beamFile> beams;
+
+  if (argc < 2) {
+    usage();
+    exit(0);
+  }
+
+  // Read command line parameters
+  while ((arg = getopt(argc, argv, "d:hj:n:p:x:")) != -1) {
+    switch (arg) {
+
+      case 'd':
+        dmBinWidth = atof(optarg);
+        break;
+
+      case 'j':
+        numThreads = atoi(optarg);
+        break;
+
+      case 'n':
+        maxBeams = atoi(optarg);
+        break;
+
+      case 'p':
+        periodBinWidth = atof(optarg);
+        break;
+
+      case 'x':
+        suffix = optarg;
+        break;
+
+      case 'h':
+        usage();
+        exit(0);
+
+      default:
+        return 0;
+        break;
+
+    }
+  }
+
+  for (int i = optind; i < argc; i++) {
+    beams.push_back(beamFile());
+    beams.back().name = argv[i];
+  }
+
+  if (beams.size() == 0) {
+    std::cerr << "You must list the CCL files of the beams after the options!" << std::endl;
+    usage();
+    exit(0);
+  }
+
+  if (periodBinWidth <= 0.0 || dmBinWidth <= 0.0) {
+    std::cerr << "Bin widths must be positive!" << std::endl;
+    exit(0);
+  }
+
+  if (numThreads < 1) {
+    numThreads = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  // Read the beams' CCL files, sharing them out between the threads
+  std::atomic<size_t> nextBeam(0);
+  std::vector<std::thread> threads;
+  for (int thread = 0; thread < std::min(numThreads, (int) beams.size()); thread++) {
+    threads.push_back(std::thread([&]() {
+      for (size_t beam = nextBeam++; beam < beams.size(); beam = nextBeam++) {
+        beams[beam].readOK = readBeamFile(beams[beam]);
+      }
+    }));
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  for (const beamFile &beam : beams) {
+    if (!beam.readOK) {
+      std::cerr << "Error opening file " << beam.name << " to read!" << std::endl;
+      exit(0);
+    }
+  }
+
+  // Put each candidate in its bin, recording the beams seen in each bin; since the beams are gone through in order, a beam
+  // that is already in a bin is always the last one added to it
+  const double logPeriodBinWidth = log1p(periodBinWidth);
+  std::vector<std::vector<int64_t> > periodBins(beams.size()), dmBins(beams.size());
+  std::unordered_map<uint64_t, std::vector<int> > binBeams;
+  size_t numCands = 0;
+  for (size_t beam = 0; beam < beams.size(); beam++) {
+    const candidateList &ccl = beams[beam].ccl;
+    periodBins[beam].resize(ccl.snr.size());
+    dmBins[beam].resize(ccl.snr.size());
+    numCands += ccl.snr.size();
+    binBeams.reserve(numCands);
+    for (size_t cand = 0; cand < ccl.snr.size(); cand++) {
+      periodBins[beam][cand] = binNumber(log(ccl.period[cand])/logPeriodBinWidth);
+      dmBins[beam][cand] = binNumber(ccl.dm[cand]/dmBinWidth);
+      std::vector<int> &seenIn = binBeams[binKey(periodBins[beam][cand], dmBins[beam][cand])];
+      if (seenIn.empty() || seenIn.back() != (int) beam) {
+        seenIn.push_back(beam);
+      }
+    }
+  }
+
+  // Count the distinct beams seen in each bin and its neighbours, marking each beam with the bin it was last counted for
+  std::unordered_map<uint64_t, int> binBeamCounts;
+  std::vector<uint64_t> lastCountedFor(beams.size(), 0);
+  uint64_t countNumber = 0;
+  binBeamCounts.reserve(binBeams.size());
+  for (const auto &bin : binBeams) {
+    const int64_t periodBin = (int32_t) (bin.first >> 32), dmBin = (int32_t) (bin.first & 0xffffffff);
+    int count = 0;
+    countNumber++;
+    for (int periodStep = -1; periodStep <= 1; periodStep++) {
+      for (int dmStep = -1; dmStep <= 1; dmStep++) {
+        auto neighbour = binBeams.find(binKey(periodBin + periodStep, dmBin + dmStep));
+        if (neighbour == binBeams.end()) {
+          continue;
+        }
+        for (int beam : neighbour->second) {
+          if (lastCountedFor[beam] != countNumber) {
+            lastCountedFor[beam] = countNumber;
+            count++;
+          }
+        }
+      }
+    }
+    binBeamCounts[bin.first] = count;
+  }
+
+  // Write each beam's CCL without the candidates seen in too many beams
+  size_t totalRemoved = 0;
+  for (size_t beam = 0; beam < beams.size(); beam++) {
+
+    const beamFile &thisBeam = beams[beam];
+    const std::string outFileName = std::string(thisBeam.name) + suffix;
+    std::ofstream outfile(outFileName, std::ofstream::binary);
+    if (!outfile.is_open()) {
+      std::cerr << "Error opening file " << outFileName << " for writing!" << std::endl;
+      exit(0);
+    }
+
+    // Copy everything up to each line that is taken out
+    size_t copiedTo = 0, removed = 0;
+    for (size_t cand = 0; cand < thisBeam.ccl.snr.size(); cand++) {
+      if (binBeamCounts[binKey(periodBins[beam][cand], dmBins[beam][cand])] > maxBeams) {
+        outfile.write(thisBeam.text + copiedTo, thisBeam.lineStarts[cand] - copiedTo);
+        copiedTo = thisBeam.lineEnds[cand];
+        removed++;
+      }
+    }
+    outfile.write(thisBeam.text + copiedTo, thisBeam.length - copiedTo);
+    outfile.close();
+    if (!outfile) {
+      std::cerr << "Error writing to " << outFileName << "!" << std::endl;
+      exit(0);
+    }
+
+    std::cout << "Beam " << beam << " (" << thisBeam.name << "): kept " << thisBeam.ccl.snr.size() - removed << " of " << thisBeam.ccl.snr.size() << " candidates" << std::endl;
+    totalRemoved += removed;
+
+    if (thisBeam.length > 0) {
+      munmap((void*) thisBeam.text, thisBeam.length);
+    }
+
+  }
+
+  std::cout << "Took out " << totalRemoved << " of " << numCands << " candidates, seen in more than " << maxBeams << " of " << beams.size() << " beams" << std::endl;
+
+  return 0;
+
+}
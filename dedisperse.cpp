@@ -0,0 +1,799 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <cstdint>
+#include <getopt.h>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <random>
+#include "dedispersionPlan.h"
+
+#define LIM 256
+
+// External function to print help if needed
+void usage() {
+  std::cout << std::endl << "Usage: dedisperse (-options) -f filFile (-l dmListFile | -d dmStart -D dmEnd)" << std::endl << std::endl;
+  std::cout << "     -f: Input .fil file" << std::endl;
+  std::cout << "     -o: Prefix for the output .tim files (default = input file name without .fil)" << std::endl;
+  std::cout << "     -l: File listing the DMs to dedisperse at, one per line" << std::endl;
+  std::cout << "     -d: First DM of a generated DM plan" << std::endl;
+  std::cout << "     -D: Last DM of a generated DM plan" << std::endl;
+  std::cout << "     -s: DM step of a generated DM plan (default = step which shifts the lowest channel by one sample)" << std::endl;
+  std::cout << "     -g: Number of output time samples to dedisperse per gulp (default = 65536)" << std::endl;
+  std::cout << "     -j: Number of threads to use (default = number of cores)" << std::endl;
+  std::cout << "     -P: Dedispersion plan cache file; read if it matches the header and DMs, otherwise (re)written" << std::endl;
+  std::cout << "     -F: Use the Fast Dispersion Measure Transform (FDMT) instead of brute-force dedispersion" << std::endl;
+  std::cout << "     -B: Compare FDMT and brute-force dedispersion on synthetic data with this many channels, then exit (no -f needed)" << std::endl << std::endl;
+  std::cout << "One SIGPROC .tim file is written per DM, named prefix_DMxxx.xx.tim. Delays are relative to the highest frequency channel." << std::endl;
+  std::cout << "The FDMT computes every integer delay of the lowest channel at once, so each requested DM is rounded to the nearest of those;" << std::endl;
+  std::cout << "the DM actually used is written to the 'refdm' header parameter." << std::endl << std::endl;
+}
+
+// Functions to write SIGPROC header strings and values
+void writeHeaderString(std::ofstream &file, const char *string) {
+  int length = strlen(string);
+  file.write((char*) &length, sizeof(int));
+  file.write(string, length);
+}
+
+void writeHeaderInt(std::ofstream &file, const char *name, int value) {
+  writeHeaderString(file, name);
+  file.write((char*) &value, sizeof(int));
+}
+
+void writeHeaderDouble(std::ofstream &file, const char *name, double value) {
+  writeHeaderString(file, name);
+  file.write((char*) &value, sizeof(double));
+}
+
+// Unpack 'numValues' values of 1-, 2-, 4-, 8-, 16-, or 32-bit data into floats
+// Sub-byte values are stored with the first value in the lowest bits, as in plotFil
+void unpackData(const unsigned char *raw, int numBits, long long numValues, float *values) {
+
+  long long i;
+
+  switch (numBits) {
+
+    case 1:
+      for (i = 0; i < numValues; i++) {
+        values[i] = (raw[i/8] >> (i%8)) & 1;
+      }
+      break;
+
+    case 2:
+      for (i = 0; i < numValues; i++) {
+        values[i] = (raw[i/4] >> (2 * (i%4))) & 3;
+      }
+      break;
+
+    case 4:
+      for (i = 0; i < numValues; i++) {
+        values[i] = (raw[i/2] >> (4 * (i%2))) & 15;
+      }
+      break;
+
+    case 8:
+      for (i = 0; i < numValues; i++) {
+        values[i] = raw[i];
+      }
+      break;
+
+    case 16:
+      for (i = 0; i < numValues; i++) {
+        values[i] = ((const uint16_t*) raw)[i];
+      }
+      break;
+
+    case 32:
+      memcpy(values, raw, sizeof(float) * numValues);
+      break;
+
+  }
+
+}
+
+// Brute-force dedispersion of one DM trial
+// 'data' holds each channel contiguously ('channelStride' samples per channel), and output sample t is the sum over channels of data[channel][t + delay[channel]]
+// The output is processed in blocks small enough to stay in cache while every channel is added to it
+void dedisperseTrial(const float *data, long long channelStride, int numChans, const int *delays, long long numOutputSamples, float *output) {
+
+  const long long blockSize = 2048;
+
+  for (long long blockStart = 0; blockStart < numOutputSamples; blockStart += blockSize) {
+
+    long long blockLength = std::min(blockSize, numOutputSamples - blockStart);
+    float *outputBlock = output + blockStart;
+
+    std::fill(outputBlock, outputBlock + blockLength, 0.0f);
+
+    for (int channel = 0; channel < numChans; channel++) {
+      const float *channelData = data + channel * channelStride + delays[channel] + blockStart;
+      for (long long sample = 0; sample < blockLength; sample++) {
+        outputBlock[sample] += channelData[sample];
+      }
+    }
+
+  }
+
+}
+
+// One sub-band of the FDMT: the (frequency-ordered) channels it covers and one dedispersed time series per delay across the sub-band
+struct fdmtSubband {
+  int firstChannel, lastChannel, numRows;
+  std::vector<float> rows;
+};
+
+// Build row 'row' of the sub-band formed by joining 'high' (higher frequencies) and 'low' (lower frequencies)
+// The delay across the joined sub-band is split into the delay across 'high', the delay from the top of 'high' to the top of 'low', and the delay across 'low'
+void fdmtMergeRow(const fdmtSubband &high, const fdmtSubband &low, fdmtSubband &merged, int row, const std::vector<double> &channelDelay, long long numSamples) {
+
+  int highRow = 0, lowRow = 0, offset = 0;
+  double span = channelDelay[low.lastChannel] - channelDelay[high.firstChannel];
+
+  if (span > 0) {
+    highRow = std::min((int) floor(row * (channelDelay[high.lastChannel] - channelDelay[high.firstChannel])/span + 0.5), high.numRows - 1);
+    offset = (int) floor(row * (channelDelay[low.firstChannel] - channelDelay[high.firstChannel])/span + 0.5);
+    lowRow = std::min(std::max(row - offset, 0), low.numRows - 1);
+  }
+
+  const float *highData = &high.rows[(size_t) highRow * numSamples];
+  const float *lowData = &low.rows[(size_t) lowRow * numSamples] + offset;
+  float *mergedData = &merged.rows[(size_t) row * numSamples];
+  long long overlap = std::max(0LL, numSamples - offset), sample;
+
+  for (sample = 0; sample < overlap; sample++) {
+    mergedData[sample] = highData[sample] + lowData[sample];
+  }
+  // Samples whose delayed low-frequency data lie beyond the end of the buffer only get the high-frequency part; these are never written out
+  for (; sample < numSamples; sample++) {
+    mergedData[sample] = highData[sample];
+  }
+
+}
+
+// Fast Dispersion Measure Transform (Zackay & Ofek 2017)
+// Channels are visited from highest to lowest frequency through 'channelOrder', and channelDelay[k] is the delay of the k-th of those channels per unit DM, in samples
+// Sub-bands are joined in pairs until one remains, giving 'maxDelay' + 1 time series in 'output', where series d has the lowest channel delayed by d samples
+// Each join costs O(numRows * numSamples), so the whole transform costs O(numSamples * (maxDelay + numChans) * log2(numChans)) rather than O(numSamples * maxDelay * numChans)
+void fdmtTransform(const float *data, long long channelStride, const std::vector<int> &channelOrder, const std::vector<double> &channelDelay, int maxDelay, long long numSamples, int numThreads, std::vector<float> &output) {
+
+  const int numChans = channelOrder.size();
+  const double totalDelay = channelDelay[numChans - 1] - channelDelay[0];
+  std::vector<fdmtSubband> subbands(numChans), merged;
+
+  // Each channel starts as a sub-band with a single (zero) delay
+  for (int channel = 0; channel < numChans; channel++) {
+    subbands[channel].firstChannel = channel;
+    subbands[channel].lastChannel = channel;
+    subbands[channel].numRows = 1;
+    subbands[channel].rows.assign(data + channelOrder[channel] * channelStride, data + channelOrder[channel] * channelStride + numSamples);
+  }
+
+  while (subbands.size() > 1) {
+
+    const int numPairs = subbands.size()/2;
+    std::vector<std::pair<int, int> > work;
+
+    merged.clear();
+    merged.resize(numPairs + subbands.size()%2);
+
+    // Work out the size of each joined sub-band; the number of delays it needs scales with its share of the total delay across the band
+    for (int pair = 0; pair < numPairs; pair++) {
+      merged[pair].firstChannel = subbands[2 * pair].firstChannel;
+      merged[pair].lastChannel = subbands[2 * pair + 1].lastChannel;
+      merged[pair].numRows = 1;
+      if (totalDelay > 0) {
+        merged[pair].numRows += (int) ceil(maxDelay * (channelDelay[merged[pair].lastChannel] - channelDelay[merged[pair].firstChannel])/totalDelay - 1e-6);
+      }
+      merged[pair].rows.resize((size_t) merged[pair].numRows * numSamples);
+      for (int row = 0; row < merged[pair].numRows; row++) {
+        work.push_back(std::make_pair(pair, row));
+      }
+    }
+
+    // An odd sub-band out is carried to the next iteration as it is
+    if (subbands.size()%2 == 1) {
+      merged.back() = std::move(subbands.back());
+    }
+
+    // Share the rows out between the threads
+    std::atomic<size_t> nextItem(0);
+    std::vector<std::thread> threads;
+    for (int thread = 0; thread < numThreads; thread++) {
+      threads.push_back(std::thread([&]() {
+        for (size_t item = nextItem++; item < work.size(); item = nextItem++) {
+          int pair = work[item].first;
+          fdmtMergeRow(subbands[2 * pair], subbands[2 * pair + 1], merged[pair], work[item].second, channelDelay, numSamples);
+        }
+      }));
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+
+    subbands.swap(merged);
+
+  }
+
+  output.swap(subbands[0].rows);
+
+}
+
+// Dedisperse synthetic data containing one dispersed pulse with both FDMT and brute force, and report how long each took and what they found
+// The pulse is placed using plotFil's per-channel delay formula, and both methods use one trial per sample of delay in the lowest channel
+void runBenchmark(int numChans, long long numSamples, double dmEnd, int numThreads) {
+
+  const double fCh1 = 1500.0, fOff = -400.0/numChans, sampTime = 64e-6;
+  const double pulseDM = 0.6 * dmEnd;
+  const long long pulseSample = numSamples/4;
+  int channel, maxDelay, row;
+  float frequency, dmDelay;
+  std::vector<int> channelOrder(numChans);
+  std::vector<double> trialDMs;
+  DedispersionPlan plan;
+
+  // Work out the delay per unit DM of each channel, relative to the highest (first) channel
+  computeDedispersionPlan(plan, fCh1, fOff, numChans, sampTime, std::vector<double>(1, dmEnd));
+  const std::vector<double> &channelDelay = plan.delayPerUnitDM;
+  for (channel = 0; channel < numChans; channel++) {
+    channelOrder[channel] = channel;
+  }
+  maxDelay = plan.maxDelay;
+  if (maxDelay + 4 >= numSamples - pulseSample) {
+    std::cerr << "Benchmark needs more than " << maxDelay + pulseSample << " samples (-g) to hold the largest delay!" << std::endl;
+    exit(0);
+  }
+  const int numDMs = maxDelay + 1;
+  const double dmPerRow = 1.0/channelDelay[numChans - 1];
+
+  std::cout << "Benchmark: " << numChans << " channels x " << numSamples << " samples, " << numDMs << " DM trials from 0 to " << dmEnd << ", pulse at sample " << pulseSample << " and DM " << pulseDM << std::endl;
+
+  // Unit-variance Gaussian noise with a four-sample pulse of amplitude 1 in every channel
+  // The pulse is wider than one sample, as real pulses are, since the FDMT's delays can be a sample or so off those of brute force
+  std::vector<float> data((size_t) numChans * numSamples);
+  std::mt19937 randomNumGenerator(12345);
+  std::normal_distribution<float> distribution(0.0, 1.0);
+  for (size_t i = 0; i < data.size(); i++) {
+    data[i] = distribution(randomNumGenerator);
+  }
+  for (channel = 0; channel < numChans; channel++) {
+    frequency = fCh1 + (float) channel * fOff;
+    dmDelay = 4.148808e3 * (pow(frequency, -2) - pow(fCh1, -2)) * pulseDM;
+    for (int bin = 0; bin < 4; bin++) {
+      data[(size_t) channel * numSamples + pulseSample + (int) floor(dmDelay/sampTime + 0.5) + bin] += 1.0;
+    }
+  }
+
+  // Brute force at the same trials the FDMT computes
+  for (row = 0; row < numDMs; row++) {
+    trialDMs.push_back(row * dmPerRow);
+  }
+  DedispersionPlan trialPlan;
+  computeDedispersionPlan(trialPlan, fCh1, fOff, numChans, sampTime, trialDMs);
+  const std::vector<int> &delays = trialPlan.delaySamps;
+  const long long numOutputSamples = numSamples - maxDelay;
+  std::vector<float> bruteForceOutput((size_t) numDMs * numOutputSamples), fdmtOutput;
+
+  auto start = std::chrono::steady_clock::now();
+  std::atomic<int> nextDM(0);
+  std::vector<std::thread> threads;
+  for (int thread = 0; thread < numThreads; thread++) {
+    threads.push_back(std::thread([&]() {
+      for (int dmIndex = nextDM++; dmIndex < numDMs; dmIndex = nextDM++) {
+        dedisperseTrial(&data[0], numSamples, numChans, &delays[(size_t) dmIndex * numChans], numOutputSamples, &bruteForceOutput[(size_t) dmIndex * numOutputSamples]);
+      }
+    }));
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  double bruteForceTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  start = std::chrono::steady_clock::now();
+  fdmtTransform(&data[0], numSamples, channelOrder, channelDelay, maxDelay, numSamples, numThreads, fdmtOutput);
+  double fdmtTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  // Find the brightest point in each DM-time plane; the noise in every trial has a standard deviation of sqrt(numChans)
+  for (int method = 0; method < 2; method++) {
+    const float *plane = method == 0 ? &bruteForceOutput[0] : &fdmtOutput[0];
+    const long long rowLength = method == 0 ? numOutputSamples : numSamples;
+    long long peakSample = 0;
+    int peakRow = 0;
+    for (row = 0; row < numDMs; row++) {
+      for (long long sample = 0; sample < numOutputSamples; sample++) {
+        if (plane[(size_t) row * rowLength + sample] > plane[(size_t) peakRow * rowLength + peakSample]) {
+          peakRow = row;
+          peakSample = sample;
+        }
+      }
+    }
+    std::cout << (method == 0 ? "  Brute force: " : "  FDMT:        ") << (method == 0 ? bruteForceTime : fdmtTime) << " s, peak S/N " << plane[(size_t) peakRow * rowLength + peakSample]/sqrt((double) numChans) << " at sample " << peakSample << " and DM " << peakRow * dmPerRow << std::endl;
+  }
+
+  // The zero-DM trial involves no rounding, so the two methods must agree there exactly (up to float summation order)
+  double maxDifference = 0.0;
+  for (long long sample = 0; sample < numOutputSamples; sample++) {
+    maxDifference = std::max(maxDifference, (double) fabs(bruteForceOutput[sample] - fdmtOutput[sample]));
+  }
+  std::cout << "  Largest zero-DM difference: " << maxDifference << std::endl;
+  std::cout << "  Expected pulse S/N: " << sqrt((double) numChans) << std::endl;
+  std::cout << "  FDMT speedup: " << bruteForceTime/fdmtTime << "x" << std::endl;
+
+}
+
+/* -- dedisperse ---------------------------------------------------------------------------------------------
+** Incoherently dedisperses a filterbank file at many DMs, writing one SIGPROC .tim time series per DM.       |
+**                                                                                                            |
+** The file is read in gulps which overlap by the largest dispersion delay. Each gulp is corner-turned so     |
+** every channel is contiguous, and the DM trials are shared out between threads. Alternatively, the FDMT can   |
+** compute all integer-delay trials of each gulp at once, which is much faster when there are many channels.   |
+** Will work with 1-, 2-, 4-, 8-, 16-, and 32-bit data.                                                       |
+------------------------------------------------------------------------------------------------------------ */
+int main(int argc, char *argv[]) {
+
+  char string[80], sourceName[80] = "unknown", outputFileName[LIM];
+  int nchar = sizeof(int), numChans = 0, numBits = 0, numIFs = 0, arg, numThreads = 0;
+  int telescopeID = 0, dataType, machineID = 0, numBeams, beamNumber, channel, maxDelay = 0, useFDMT = 0, benchmarkChans = 0, gulpRequested = 0;
+  double obsStart = 0.0, sampTime, fCh1, fOff, RA = 0.0, Dec = 0.0, azimuthStart, zenithAngleStart;
+  double dmStart = -1.0, dmEnd = -1.0, dmStep = 0.0, dm, highestFrequency, lowestFrequency;
+  long long numSamps = 0, numSamples, numOutputSamples, outputSamplesPerGulp = 65536, gulpSamples, outputSample;
+  std::string outputPrefix, inputFileName, planFileName;
+  std::vector<double> DMs;
+  std::ifstream file, dmListFile;
+
+  // If the user has not provided any arguments or has forgotten to use a flag, print usage and exit
+  if (argc < 3) {
+    usage();
+    exit(0);
+  }
+
+  // Read command line parameters
+  while ((arg = getopt(argc, argv, "B:d:D:f:Fg:hj:l:o:P:s:")) != -1) {
+    switch (arg) {
+
+      case 'B':
+        benchmarkChans = atoi(optarg);
+        break;
+
+      case 'd':
+        dmStart = atof(optarg);
+        break;
+
+      case 'D':
+        dmEnd = atof(optarg);
+        break;
+
+      case 'f':
+        file.open(optarg, std::ifstream::binary | std::ifstream::ate);
+        if (!file.is_open()) {
+          std::cerr << "Error opening file " << optarg << std::endl;
+          usage();
+          exit(0);
+        }
+        inputFileName = optarg;
+        break;
+
+      case 'F':
+        useFDMT = 1;
+        break;
+
+      case 'g':
+        outputSamplesPerGulp = atoll(optarg);
+        if (outputSamplesPerGulp < 1) {
+          std::cerr << "Gulp must contain at least one output sample! Defaulting to 65536!" << std::endl;
+          outputSamplesPerGulp = 65536;
+        }
+        gulpRequested = 1;
+        break;
+
+      case 'j':
+        numThreads = atoi(optarg);
+        break;
+
+      case 'l':
+        dmListFile.open(optarg);
+        if (!dmListFile.is_open()) {
+          std::cerr << "Could not open file " << optarg << " to read!" << std::endl;
+          exit(0);
+        }
+        break;
+
+      case 'o':
+        outputPrefix = optarg;
+        break;
+
+      case 'P':
+        planFileName = optarg;
+        break;
+
+      case 's':
+        dmStep = atof(optarg);
+        if (dmStep <= 0) {
+          std::cerr << "DM step must be positive! Using the default!" << std::endl;
+          dmStep = 0.0;
+        }
+        break;
+
+      case 'h':
+        usage();
+        exit(0);
+
+      default:
+        return 0;
+        break;
+
+    }
+  }
+
+  if (numThreads < 1) {
+    numThreads = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  // Run the synthetic comparison instead of dedispersing a file
+  if (benchmarkChans > 0) {
+    runBenchmark(benchmarkChans, gulpRequested ? outputSamplesPerGulp : 16384, dmEnd > 0 ? dmEnd : 100.0, numThreads);
+    return 0;
+  }
+
+  // Check if the file has failed to open
+  if (!file.is_open()) {
+    std::cerr << "You must input a .fil file with the -f flag!" << std::endl;
+    usage();
+    exit(0);
+  }
+
+  // Check that exactly one way of choosing DMs has been given
+  if (dmListFile.is_open() == (dmStart >= 0 && dmEnd >= dmStart)) {
+    std::cerr << "You must either give a DM list with -l or a DM range with -d and -D!" << std::endl;
+    usage();
+    exit(0);
+  }
+
+  // Name the output files after the input file unless told otherwise
+  if (outputPrefix.empty()) {
+    outputPrefix = inputFileName;
+    if (outputPrefix.size() > 4 && outputPrefix.compare(outputPrefix.size() - 4, 4, ".fil") == 0) {
+      outputPrefix.erase(outputPrefix.size() - 4);
+    }
+  }
+
+  // Since we opened the file at the end, report the size of the file. Once we have the header size we can calculate the length of the data.
+  const size_t fileSize = file.tellg();
+
+  // Seek back to the beginning of the file
+  file.seekg(0, file.beg);
+
+  // Read header parameters until "HEADER_END" is encountered
+  while (true) {
+
+    // Read string size
+    strcpy(string, "ERROR");
+    file.read((char*) &nchar, sizeof(int));
+    if (!file) {
+      std::cerr << "Error reading header string size!" << std::endl;
+      exit(0);
+    }
+
+    // Skip wrong strings
+    if (!(nchar > 1 && nchar < 80)) {
+      continue;
+    }
+
+    // Read string
+    file.read((char*) string, nchar);
+    if (!file) {
+      std::cerr << "Could not read header string!" << std::endl;
+      exit(0);
+    }
+    string[nchar] = '\0';
+
+    // Exit at end of header
+    if (strcmp(string, "HEADER_END") == 0) {
+      break;
+    }
+
+    // Read parameters
+    if (strcmp(string, "HEADER_START") == 0) {
+      continue;
+    } else if (strcmp(string, "tsamp") == 0) {
+      file.read((char*) &sampTime, sizeof(double));
+      if (!file) {
+        std::cerr << "Did not read header parameter 'tsamp' properly!" << std::endl;
+        exit(0);
+      }
+    } else if (strcmp(string, "tstart") == 0) {
+      file.read((char*) &obsStart, sizeof(double));
+      if (!file) {
+        std::cerr << "Did not read header parameter 'tstart' properly!" << std::endl;
+        exit(0);
+      }
+    } else if (strcmp(string, "fch1") == 0) {
+      file.read((char*) &fCh1, sizeof(double));
+      if (!file) {
+        std::cerr << "Did not read header parameter 'fch1' properly!" << std::endl;
+        exit(0);
+      }
+    } else if (strcmp(string, "foff") == 0) {
+      file.read((char*) &fOff, sizeof(double));
+      if (!file) {
+        std::cerr << "Did not read header parameter 'foff' properly!" << std::endl;
+        exit(0);
+      }
+    } else if (strcmp(string, "nchans") == 0) {
+      file.read((char*) &numChans, sizeof(int));
+      if (!file) {
+        std::cerr << "Did not read header parameter 'nchans' properly!" << std::endl;
+        exit(0);
+      }
+    } else if (strcmp(string, "nifs") == 0) {
+      file.read((char*) &numIFs, sizeof(int));
+      if (!file) {
+        std::cerr << "Did not read header parameter 'nifs' properly!" << std::endl;
+        exit(0);
+      }
+    } else if (strcmp(string, "nbits") == 0) {
+      file.read((char*) &numBits, sizeof(int));
+      if (!file) {
+        std::cerr << "Did not read header parameter 'nbits' properly!" << std::endl;
+        exit(0);
+      }
+    } else if (strcmp(string, "nsamples") == 0) {
+      file.read((char*) &numSamps, sizeof(int));
+      if (!file) {
+        std::cerr << "Did not read header parameter 'nsamples' properly!" << std::endl;
+        exit(0);
+      }
+    } else if (strcmp(string, "machine_id") == 0) {
+      file.read((char*) &machineID, sizeof(int));
+      if (!file) {
+        std::cerr << "Did not read header parameter 'machine_id' properly!" << std::endl;
+        exit(0);
+      }
+    } else if (strcmp(string, "telescope_id") == 0) {
+      file.read((char*) &telescopeID, sizeof(int));
+      if (!file) {
+        std::cerr << "Did not read header parameter 'telescope_id' properly!" << std::endl;
+        exit(0);
+      }
+    } else if (strcmp(string, "data_type") == 0) {
+      file.read((char*) &dataType, sizeof(int));
+      if (!file) {
+        std::cerr << "Did not read header parameter 'data_type' properly!" << std::endl;
+        exit(0);
+      }
+    } else if (strcmp(string, "source_name") == 0) {
+      file.read((char*) &nchar, sizeof(int));
+      file.read((char*) sourceName, nchar);
+      sourceName[nchar] = '\0';
+      if (!file) {
+        std::cerr << "Did not read header parameter 'source_name' properly!" << std::endl;
+        exit(0);
+      }
+    } else if (strcmp(string, "nbeams") == 0) {
+      file.read((char*) &numBeams, sizeof(int));
+      if (!file) {
+        std::cerr << "Did not read header parameter 'nbeams' properly!" << std::endl;
+        exit(0);
+      }
+    } else if (strcmp(string, "ibeam") == 0) {
+      file.read((char*) &beamNumber, sizeof(int));
+      if (!file) {
+        std::cerr << "Did not read header parameter 'ibeam' properly!" << std::endl;
+        exit(0);
+      }
+    } else if (strcmp(string, "src_raj") == 0) {
+      file.read((char*) &RA, sizeof(double));
+      if (!file) {
+        std::cerr << "Did not read header parameter 'src_raj' properly!" << std::endl;
+        exit(0);
+      }
+    } else if (strcmp(string, "src_dej") == 0) {
+      file.read((char*) &Dec, sizeof(double));
+      if (!file) {
+        std::cerr << "Did not read header parameter 'src_dej' properly!" << std::endl;
+        exit(0);
+      }
+    } else if (strcmp(string, "az_start") == 0) {
+      file.read((char*) &azimuthStart, sizeof(double));
+      if (!file) {
+        std::cerr << "Did not read header parameter 'az_start' properly!" << std::endl;
+        exit(0);
+      }
+    } else if (strcmp(string, "za_start") == 0) {
+      file.read((char*) &zenithAngleStart, sizeof(double));
+      if (!file) {
+        std::cerr << "Did not read header parameter 'za_start' properly!" << std::endl;
+        exit(0);
+      }
+    } else {
+      std::cerr << "Unknown header parameter " << string << std::endl;
+    }
+
+  }
+
+  std::cerr << "Done reading header!" << std::endl;
+
+  if (numBits != 1 && numBits != 2 && numBits != 4 && numBits != 8 && numBits != 16 && numBits != 32) {
+    std::cerr << "Cannot read " << numBits << " bit data!" << std::endl << "Data must be 1-, 2-, 4-, 8-, 16-, or 32-bit!" << std::endl;
+    exit(0);
+  }
+  if (((long long) numChans * numBits)%8 != 0) {
+    std::cerr << "Each time sample must fill a whole number of bytes!" << std::endl;
+    exit(0);
+  }
+
+  const size_t rowBytes = (size_t) numChans * numBits/8;
+  numSamples = (fileSize - (size_t) file.tellg())/rowBytes;
+
+  // Find the band edges; delays are measured from the highest frequency channel
+  highestFrequency = std::max(fCh1, fCh1 + (numChans - 1) * fOff);
+  lowestFrequency = std::min(fCh1, fCh1 + (numChans - 1) * fOff);
+
+  // Build the list of DMs, either from the user's file or from the requested range
+  if (dmListFile.is_open()) {
+    while (dmListFile >> dm) {
+      // A negative DM would delay channels backwards and read before the start of the input
+      if (!std::isfinite(dm) || dm < 0.0) {
+        std::cerr << "DM " << dm << " in the DM list is not a non-negative number!" << std::endl;
+        exit(0);
+      }
+      DMs.push_back(dm);
+    }
+    dmListFile.close();
+  } else {
+    // By default, step so that each trial moves the lowest channel by one more sample than the last
+    if (dmStep == 0.0) {
+      dmStep = sampTime/(4.148808e3 * (pow(lowestFrequency, -2) - pow(highestFrequency, -2)));
+    }
+    for (dm = dmStart; dm <= dmEnd + 0.5 * dmStep; dm += dmStep) {
+      DMs.push_back(dm);
+    }
+  }
+
+  if (DMs.size() == 0) {
+    std::cerr << "No DMs to dedisperse at!" << std::endl;
+    exit(0);
+  }
+
+  const int numDMs = DMs.size();
+
+  // Get the delays in samples for every DM trial, stored as delays[dmIndex * numChans + channel]
+  DedispersionPlan plan;
+  getDedispersionPlan(plan, planFileName.empty() ? NULL : planFileName.c_str(), fCh1, fOff, numChans, sampTime, DMs);
+  const std::vector<double> &delayPerUnitDM = plan.delayPerUnitDM;
+  const std::vector<int> &delays = plan.delaySamps;
+  maxDelay = plan.maxDelay;
+
+  // The last 'maxDelay' samples cannot be fully dedispersed
+  numOutputSamples = numSamples - maxDelay;
+  if (numOutputSamples < 1) {
+    std::cerr << "The file (" << numSamples << " samples) is shorter than the largest dispersion delay (" << maxDelay << " samples)!" << std::endl;
+    exit(0);
+  }
+
+  // For the FDMT, each DM maps onto the trial with the nearest delay in the lowest channel, and channels are taken in order of decreasing frequency
+  std::vector<int> fdmtRow(numDMs), channelOrder(numChans);
+  std::vector<double> orderedDelayPerUnitDM(numChans);
+  std::vector<float> fdmtOutput;
+  const int lowestChannel = fOff < 0 ? numChans - 1 : 0;
+  if (useFDMT) {
+    for (channel = 0; channel < numChans; channel++) {
+      channelOrder[channel] = fOff < 0 ? channel : numChans - 1 - channel;
+      orderedDelayPerUnitDM[channel] = delayPerUnitDM[channelOrder[channel]];
+    }
+    for (int dmIndex = 0; dmIndex < numDMs; dmIndex++) {
+      fdmtRow[dmIndex] = (int) floor(delayPerUnitDM[lowestChannel] * DMs[dmIndex] + 0.5);
+    }
+    // The FDMT holds about (maxDelay + numChans) time series per gulp, so keep the default gulp to roughly a gigabyte
+    if (!gulpRequested) {
+      outputSamplesPerGulp = std::max(4096LL, (1LL << 28)/(maxDelay + numChans) - maxDelay);
+    }
+  }
+
+  std::cout << "Dedispersing " << numSamples << " samples x " << numChans << " channels at " << numDMs << " DMs from " << DMs.front() << " to " << DMs.back() << " using " << numThreads << " threads" << (useFDMT ? " and the FDMT" : "") << std::endl;
+  std::cout << "Maximum delay is " << maxDelay << " samples; writing " << numOutputSamples << " samples per DM" << std::endl;
+
+  // Open one output time series per DM and write its header
+  std::vector<std::ofstream> outputFiles(numDMs);
+  for (int dmIndex = 0; dmIndex < numDMs; dmIndex++) {
+    snprintf(outputFileName, sizeof(outputFileName), "%s_DM%.2f.tim", outputPrefix.c_str(), DMs[dmIndex]);
+    outputFiles[dmIndex].open(outputFileName, std::ofstream::binary);
+    if (!outputFiles[dmIndex].is_open()) {
+      std::cerr << "Could not open file " << outputFileName << " to write! (Too many DMs for the open file limit?)" << std::endl;
+      exit(0);
+    }
+    writeHeaderString(outputFiles[dmIndex], "HEADER_START");
+    writeHeaderString(outputFiles[dmIndex], "source_name");
+    writeHeaderString(outputFiles[dmIndex], sourceName);
+    writeHeaderInt(outputFiles[dmIndex], "telescope_id", telescopeID);
+    writeHeaderInt(outputFiles[dmIndex], "machine_id", machineID);
+    writeHeaderInt(outputFiles[dmIndex], "data_type", 2);
+    writeHeaderDouble(outputFiles[dmIndex], "src_raj", RA);
+    writeHeaderDouble(outputFiles[dmIndex], "src_dej", Dec);
+    writeHeaderDouble(outputFiles[dmIndex], "fch1", highestFrequency);
+    writeHeaderInt(outputFiles[dmIndex], "nchans", 1);
+    writeHeaderInt(outputFiles[dmIndex], "nbits", 32);
+    writeHeaderInt(outputFiles[dmIndex], "nifs", 1);
+    writeHeaderDouble(outputFiles[dmIndex], "tstart", obsStart);
+    writeHeaderDouble(outputFiles[dmIndex], "tsamp", sampTime);
+    writeHeaderDouble(outputFiles[dmIndex], "refdm", useFDMT ? fdmtRow[dmIndex]/delayPerUnitDM[lowestChannel] : DMs[dmIndex]);
+    writeHeaderString(outputFiles[dmIndex], "HEADER_END");
+  }
+
+  // Each gulp holds 'outputSamplesPerGulp' new samples plus the 'maxDelay' samples needed to dedisperse them
+  const long long channelStride = outputSamplesPerGulp + maxDelay;
+  std::vector<float> data((size_t) numChans * channelStride), row(numChans);
+  std::vector<unsigned char> rawGulp(channelStride * rowBytes);
+  std::vector<std::vector<float> > threadOutput(numThreads, std::vector<float>(outputSamplesPerGulp));
+  long long samplesInBuffer = 0, samplesToRead, sample;
+
+  for (outputSample = 0; outputSample < numOutputSamples; outputSample += gulpSamples) {
+
+    gulpSamples = std::min(outputSamplesPerGulp, numOutputSamples - outputSample);
+
+    // Keep the overlap from the previous gulp at the start of each channel
+    if (samplesInBuffer > 0) {
+      for (channel = 0; channel < numChans; channel++) {
+        float *channelData = &data[(size_t) channel * channelStride];
+        std::copy(channelData + samplesInBuffer - maxDelay, channelData + samplesInBuffer, channelData);
+      }
+      samplesInBuffer = maxDelay;
+    }
+
+    // Read enough new samples to dedisperse this gulp and corner-turn them so each channel is contiguous
+    samplesToRead = gulpSamples + maxDelay - samplesInBuffer;
+    file.read((char*) &rawGulp[0], samplesToRead * rowBytes);
+    if (!file) {
+      std::cerr << "Could not read data properly!" << std::endl;
+      exit(0);
+    }
+    for (sample = 0; sample < samplesToRead; sample++) {
+      unpackData(&rawGulp[sample * rowBytes], numBits, numChans, &row[0]);
+      for (channel = 0; channel < numChans; channel++) {
+        data[(size_t) channel * channelStride + samplesInBuffer + sample] = row[channel];
+      }
+    }
+    samplesInBuffer += samplesToRead;
+
+    // The FDMT gives every trial at once, so just write out the requested ones
+    if (useFDMT) {
+      fdmtTransform(&data[0], channelStride, channelOrder, orderedDelayPerUnitDM, maxDelay, samplesInBuffer, numThreads, fdmtOutput);
+      for (int dmIndex = 0; dmIndex < numDMs; dmIndex++) {
+        outputFiles[dmIndex].write((char*) &fdmtOutput[(size_t) fdmtRow[dmIndex] * samplesInBuffer], sizeof(float) * gulpSamples);
+      }
+      continue;
+    }
+
+    // Share the DM trials out between the threads; each thread writes the DMs it dedisperses
+    std::atomic<int> nextDM(0);
+    std::vector<std::thread> threads;
+    for (int thread = 0; thread < numThreads; thread++) {
+      threads.push_back(std::thread([&, thread]() {
+        for (int dmIndex = nextDM++; dmIndex < numDMs; dmIndex = nextDM++) {
+          dedisperseTrial(&data[0], channelStride, numChans, &delays[(size_t) dmIndex * numChans], gulpSamples, &threadOutput[thread][0]);
+          outputFiles[dmIndex].write((char*) &threadOutput[thread][0], sizeof(float) * gulpSamples);
+        }
+      }));
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+
+  }
+
+  // Close all files
+  file.close();
+  for (int dmIndex = 0; dmIndex < numDMs; dmIndex++) {
+    outputFiles[dmIndex].close();
+  }
+
+  return 0;
+
+}
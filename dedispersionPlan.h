@@ -0,0 +1,162 @@
+#ifndef DEDISPERSIONPLAN_H
+#define DEDISPERSIONPLAN_H
+
+#include <cstring>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+
+/* -- dedispersionPlan -------------------------------------------------------------------------------------------
+** Dispersion delays of every channel at every DM of a list, for the channel frequencies and sampling time in a |
+** filterbank header. Delays are measured from the highest frequency channel (fch1 for the usual negative foff).  |
+**                                                                                                               |
+** The delay of a channel is 4.148808e3 * (f^-2 - fhigh^-2) * DM seconds, so the per-channel factor is computed  |
+** once and scaled for each DM. A plan can be cached in a small binary file and reused as long as the header     |
+** values and DM list are unchanged. Used by plotFil and dedisperse.                                              |
+--------------------------------------------------------------------------------------------------------------- */
+
+struct DedispersionPlan {
+  double fCh1, fOff, sampTime;
+  int numChans, maxDelay;
+  std::vector<double> DMs;
+  // Delay per unit DM of each channel, in samples
+  std::vector<double> delayPerUnitDM;
+  // Delay of each channel at each DM, rounded to the nearest sample, stored as delaySamps[dmIndex * numChans + channel]
+  std::vector<int> delaySamps;
+  // What is left after rounding, i.e. the exact delay minus delaySamps, in samples (between -0.5 and 0.5)
+  std::vector<float> delayFraction;
+};
+
+// Identifies a plan cache file
+const char dedispersionPlanMagic[8] = {'D', 'D', 'P', 'L', 'A', 'N', '0', '1'};
+
+// Fill in a plan for the given header values and DMs
+inline void computeDedispersionPlan(DedispersionPlan &plan, double fCh1, double fOff, int numChans, double sampTime, const std::vector<double> &DMs) {
+
+  double frequency, highestFrequency = std::max(fCh1, fCh1 + (numChans - 1) * fOff), exactDelay;
+  size_t index;
+
+  plan.fCh1 = fCh1;
+  plan.fOff = fOff;
+  plan.numChans = numChans;
+  plan.sampTime = sampTime;
+  plan.DMs = DMs;
+  plan.maxDelay = 0;
+
+  plan.delayPerUnitDM.resize(numChans);
+  for (int channel = 0; channel < numChans; channel++) {
+    frequency = fCh1 + channel * fOff;
+    plan.delayPerUnitDM[channel] = 4.148808e3 * (1.0/(frequency * frequency) - 1.0/(highestFrequency * highestFrequency))/sampTime;
+  }
+
+  plan.delaySamps.resize(DMs.size() * numChans);
+  plan.delayFraction.resize(DMs.size() * numChans);
+  for (size_t dmIndex = 0; dmIndex < DMs.size(); dmIndex++) {
+    for (int channel = 0; channel < numChans; channel++) {
+      index = dmIndex * numChans + channel;
+      exactDelay = plan.delayPerUnitDM[channel] * DMs[dmIndex];
+      plan.delaySamps[index] = (int) floor(exactDelay + 0.5);
+      plan.delayFraction[index] = exactDelay - plan.delaySamps[index];
+      plan.maxDelay = std::max(plan.maxDelay, plan.delaySamps[index]);
+    }
+  }
+
+}
+
+// Write a plan to a cache file
+// The header values and DM list are stored first, so a later run can check the cache matches before using it
+// Returns 1 on success, 0 otherwise
+inline int saveDedispersionPlan(const DedispersionPlan &plan, const char *fileName) {
+
+  int numDMs = plan.DMs.size();
+  std::ofstream file(fileName, std::ofstream::binary);
+
+  if (!file.is_open()) {
+    return 0;
+  }
+
+  file.write(dedispersionPlanMagic, sizeof(dedispersionPlanMagic));
+  file.write((char*) &plan.fCh1, sizeof(double));
+  file.write((char*) &plan.fOff, sizeof(double));
+  file.write((char*) &plan.sampTime, sizeof(double));
+  file.write((char*) &plan.numChans, sizeof(int));
+  file.write((char*) &numDMs, sizeof(int));
+  file.write((char*) &plan.DMs[0], sizeof(double) * numDMs);
+  file.write((char*) &plan.maxDelay, sizeof(int));
+  file.write((char*) &plan.delayPerUnitDM[0], sizeof(double) * plan.numChans);
+  file.write((char*) &plan.delaySamps[0], sizeof(int) * plan.delaySamps.size());
+  file.write((char*) &plan.delayFraction[0], sizeof(float) * plan.delayFraction.size());
+
+  return file ? 1 : 0;
+
+}
+
+// Read a plan from a cache file, but only if it was made for exactly these header values and DMs
+// Returns 1 if the plan was loaded, 0 if the file is missing, unreadable, or for something else
+inline int loadDedispersionPlan(DedispersionPlan &plan, const char *fileName, double fCh1, double fOff, int numChans, double sampTime, const std::vector<double> &DMs) {
+
+  char magic[sizeof(dedispersionPlanMagic)];
+  int fileNumChans, fileNumDMs;
+  double fileFCh1, fileFOff, fileSampTime;
+  std::ifstream file(fileName, std::ifstream::binary);
+
+  if (!file.is_open()) {
+    return 0;
+  }
+
+  file.read(magic, sizeof(magic));
+  file.read((char*) &fileFCh1, sizeof(double));
+  file.read((char*) &fileFOff, sizeof(double));
+  file.read((char*) &fileSampTime, sizeof(double));
+  file.read((char*) &fileNumChans, sizeof(int));
+  file.read((char*) &fileNumDMs, sizeof(int));
+  if (!file || memcmp(magic, dedispersionPlanMagic, sizeof(magic)) != 0 || fileFCh1 != fCh1 || fileFOff != fOff || fileSampTime != sampTime || fileNumChans != numChans || fileNumDMs != (int) DMs.size()) {
+    return 0;
+  }
+
+  plan.DMs.resize(fileNumDMs);
+  file.read((char*) &plan.DMs[0], sizeof(double) * fileNumDMs);
+  if (!file || plan.DMs != DMs) {
+    return 0;
+  }
+
+  plan.fCh1 = fCh1;
+  plan.fOff = fOff;
+  plan.sampTime = sampTime;
+  plan.numChans = numChans;
+  plan.delayPerUnitDM.resize(numChans);
+  plan.delaySamps.resize((size_t) fileNumDMs * numChans);
+  plan.delayFraction.resize((size_t) fileNumDMs * numChans);
+  file.read((char*) &plan.maxDelay, sizeof(int));
+  file.read((char*) &plan.delayPerUnitDM[0], sizeof(double) * numChans);
+  file.read((char*) &plan.delaySamps[0], sizeof(int) * plan.delaySamps.size());
+  file.read((char*) &plan.delayFraction[0], sizeof(float) * plan.delayFraction.size());
+
+  return file ? 1 : 0;
+
+}
+
+// Get a plan, reading it from 'cacheFileName' if that holds a matching plan, and otherwise computing it and (re)writing the cache
+// Pass NULL as 'cacheFileName' to always compute the plan without caching it
+inline void getDedispersionPlan(DedispersionPlan &plan, const char *cacheFileName, double fCh1, double fOff, int numChans, double sampTime, const std::vector<double> &DMs) {
+
+  if (cacheFileName != NULL && loadDedispersionPlan(plan, cacheFileName, fCh1, fOff, numChans, sampTime, DMs)) {
+    std::cout << "Read dedispersion plan from " << cacheFileName << std::endl;
+    return;
+  }
+
+  computeDedispersionPlan(plan, fCh1, fOff, numChans, sampTime, DMs);
+
+  if (cacheFileName != NULL) {
+    if (saveDedispersionPlan(plan, cacheFileName)) {
+      std::cout << "Wrote dedispersion plan to " << cacheFileName << std::endl;
+    } else {
+      std::cerr << "Could not write dedispersion plan to " << cacheFileName << "!" << std::endl;
+    }
+  }
+
+}
+
+#endif
@@ -1,53 +1,288 @@
 #include <cstdio>
 #include <cstring>
 #include <cmath>
+#include <cctype>
 #include <cstdlib>
 #include <fstream>
 #include <iostream>
 #include <getopt.h>
-#include <iterator>
+#include <charconv>
+#include <string>
+#include <vector>
+#include <utility>
 
 // External function to print help if needed
 void usage() {
-  std::cout << std::endl << "Usage: dmReducer -f inFileName -o outFileName" << std::endl << std::endl;
+  std::cout << std::endl << "Usage: dmReducer (-options) -f inFileName -o outFileName" << std::endl;
+  std::cout << "       dmReducer (-options) inFileName1 inFileName2 ..." << std::endl << std::endl;
+  std::cout << "     -f: Input .dm file" << std::endl;
+  std::cout << "     -o: Output .dm file" << std::endl;
+  std::cout << "     -l: Keep events with arrival times up to this many seconds (default = 60)" << std::endl;
+  std::cout << "     -F: Filterbank file whose length (nsamples x tsamp) is used instead of -l" << std::endl;
+  std::cout << "     -x: Suffix added to the names of input files given without -f to make their output file names (default = .reduced)" << std::endl << std::endl;
+}
+
+// Length of a filterbank file in seconds, from nsamples and tsamp in its header
+// If the header has no nsamples, the number of samples is worked out from the size of the file
+double filterbankLength(const char *fileName) {
+
+  char string[80];
+  int nchar = sizeof(int), numChans = 0, numBits = 0, numIFs = 1, intValue, headerSamps = 0;
+  long long numSamps;
+  double doubleValue, sampTime = 0.0;
+  std::ifstream file(fileName, std::ifstream::binary | std::ifstream::ate);
+
+  if (!file.is_open()) {
+    std::cerr << "Error opening file " << fileName << std::endl;
+    exit(0);
+  }
+
+  // Since we opened the file at the end, report the size of the file, then seek back to the beginning
+  const size_t fileSize = file.tellg();
+  file.seekg(0, file.beg);
+
+  // Read header parameters until "HEADER_END" is encountered
+  while (true) {
+
+    // Read string size
+    strcpy(string, "ERROR");
+    file.read((char*) &nchar, sizeof(int));
+    if (!file) {
+      std::cerr << "Error reading header string size!" << std::endl;
+      exit(0);
+    }
+
+    // Skip wrong strings
+    if (!(nchar > 1 && nchar < 80)) {
+      continue;
+    }
+
+    // Read string
+    file.read((char*) string, nchar);
+    if (!file) {
+      std::cerr << "Could not read header string!" << std::endl;
+      exit(0);
+    }
+    string[nchar] = '\0';
+
+    // Exit at end of header
+    if (strcmp(string, "HEADER_END") == 0) {
+      break;
+    }
+
+    // Read parameters, keeping the ones needed for the length of the file and skipping over the rest
+    if (strcmp(string, "HEADER_START") == 0) {
+      continue;
+    } else if (strcmp(string, "source_name") == 0 || strcmp(string, "rawdatafile") == 0) {
+      file.read((char*) &nchar, sizeof(int));
+      file.seekg(nchar, file.cur);
+    } else if (strcmp(string, "tsamp") == 0) {
+      file.read((char*) &sampTime, sizeof(double));
+    } else if (strcmp(string, "tstart") == 0 || strcmp(string, "fch1") == 0 || strcmp(string, "foff") == 0 || strcmp(string, "refdm") == 0 ||
+               strcmp(string, "src_raj") == 0 || strcmp(string, "src_dej") == 0 || strcmp(string, "az_start") == 0 || strcmp(string, "za_start") == 0) {
+      file.read((char*) &doubleValue, sizeof(double));
+    } else if (strcmp(string, "nchans") == 0) {
+      file.read((char*) &numChans, sizeof(int));
+    } else if (strcmp(string, "nbits") == 0) {
+      file.read((char*) &numBits, sizeof(int));
+    } else if (strcmp(string, "nifs") == 0) {
+      file.read((char*) &numIFs, sizeof(int));
+    } else if (strcmp(string, "nsamples") == 0) {
+      file.read((char*) &headerSamps, sizeof(int));
+    } else if (strcmp(string, "machine_id") == 0 || strcmp(string, "telescope_id") == 0 || strcmp(string, "data_type") == 0 || strcmp(string, "nbeams") == 0 || strcmp(string, "ibeam") == 0) {
+      file.read((char*) &intValue, sizeof(int));
+    }
+    if (!file) {
+      std::cerr << "Did not read header parameter '" << string << "' properly!" << std::endl;
+      exit(0);
+    }
+
+  }
+
+  // Work out the number of samples from the size of the data if the header doesn't say
+  numSamps = headerSamps;
+  if (numSamps <= 0) {
+    if (numChans <= 0 || numBits <= 0) {
+      std::cerr << "Header of " << fileName << " has no nsamples, nchans, or nbits, so its length can't be found!" << std::endl;
+      exit(0);
+    }
+    const size_t headerLength = file.tellg();
+    numSamps = (long long) (fileSize - headerLength) * 8/((long long) numChans * numIFs * numBits);
+  }
+
+  if (sampTime <= 0.0) {
+    std::cerr << "Header of " << fileName << " has no tsamp, so its length can't be found!" << std::endl;
+    exit(0);
+  }
+
+  return numSamps * sampTime;
+
+}
+
+// Write events from an ASCII event file (the start MJD, then time, DM, S/N, and width of each event) with arrival times up to 'cutoff' seconds to another
+// The input is read in large blocks and parsed in place, and the output is built up in a buffer and written in large blocks
+// Values are written as the standard streams would write them (six significant figures, each followed by a space), and the MJD is copied exactly
+// Returns the number of events written
+long long reduceEventFile(const char *inFileName, const char *outFileName, double cutoff) {
+
+  const size_t blockSize = 1 << 24, outputBufferSize = 1 << 20;
+  std::vector<char> block(blockSize), output;
+  size_t carried = 0, outputLength = 0;
+  long long numberWritten = 0;
+  int numberOfValues = 0;
+  bool haveMJD = false, parseError = false;
+  double values[4];
+  std::ifstream infile(inFileName, std::ifstream::binary);
+  std::ofstream outfile;
+
+  if (!infile.is_open()) {
+    std::cerr << std::endl << "Error opening file " << inFileName << " for reading!" << std::endl;
+    return -1;
+  }
+  outfile.open(outFileName, std::ofstream::binary);
+  if (!outfile.is_open()) {
+    std::cerr << std::endl << "Error opening file " << outFileName << " for writing!" << std::endl;
+    return -1;
+  }
+
+  // Each line needs at most 4 * (13 + 1) + 1 characters
+  output.resize(outputBufferSize + 64);
+
+  while (!parseError) {
+
+    // Fill the block after any partial token left over from the last one
+    infile.read(&block[carried], blockSize - carried);
+    const size_t blockLength = carried + infile.gcount();
+    const bool lastBlock = infile.gcount() < (std::streamsize) (blockSize - carried);
+
+    // Only parse up to the last whitespace in the block, unless it is the last block, as the final token may continue in the next block
+    size_t parseEnd = blockLength;
+    if (!lastBlock) {
+      while (parseEnd > 0 && !isspace((unsigned char) block[parseEnd - 1])) {
+        parseEnd--;
+      }
+      if (parseEnd == 0) {
+        std::cerr << "Could not find the end of a value in " << inFileName << "!" << std::endl;
+        break;
+      }
+    }
+
+    const char *position = &block[0], *end = &block[0] + parseEnd;
+    while (true) {
+
+      // Skip whitespace to the start of the next token
+      while (position < end && isspace((unsigned char) *position)) {
+        position++;
+      }
+      if (position == end) {
+        break;
+      }
+      const char *tokenEnd = position;
+      while (tokenEnd < end && !isspace((unsigned char) *tokenEnd)) {
+        tokenEnd++;
+      }
+
+      // The first token is the start MJD, which is copied to the output exactly as it is
+      if (!haveMJD) {
+        double MJD;
+        if (tokenEnd - position > 60 || std::from_chars(position, tokenEnd, MJD).ec != std::errc()) {
+          parseError = true;
+          break;
+        }
+        memcpy(&output[outputLength], position, tokenEnd - position);
+        outputLength += tokenEnd - position;
+        output[outputLength++] = '\n';
+        haveMJD = true;
+        position = tokenEnd;
+        continue;
+      }
+
+      // Stop at the first thing that isn't a number, as reading with the standard streams would
+      if (std::from_chars(position, tokenEnd, values[numberOfValues]).ec != std::errc()) {
+        parseError = true;
+        break;
+      }
+      position = tokenEnd;
+
+      // With a whole event, write it if it arrived before the cutoff
+      if (++numberOfValues == 4) {
+        numberOfValues = 0;
+        if (values[0] <= cutoff) {
+          for (int value = 0; value < 4; value++) {
+            outputLength = std::to_chars(&output[outputLength], &output[0] + output.size(), values[value], std::chars_format::general, 6).ptr - &output[0];
+            output[outputLength++] = ' ';
+          }
+          output[outputLength++] = '\n';
+          numberWritten++;
+          if (outputLength >= outputBufferSize) {
+            outfile.write(&output[0], outputLength);
+            outputLength = 0;
+          }
+        }
+      }
+
+    }
+
+    if (lastBlock) {
+      break;
+    }
+
+    // Move the unparsed end of the block to the start for the next read
+    carried = blockLength - parseEnd;
+    memmove(&block[0], &block[parseEnd], carried);
+
+  }
+
+  outfile.write(&output[0], outputLength);
+  if (!outfile) {
+    std::cerr << "Error writing to " << outFileName << "!" << std::endl;
+  }
+
+  return numberWritten;
+
 }
 
 /* -- dmReducer ------------------------------------------------------------------------------------------------------------------
 ** Removes events from an ASCII event file which have arrival times beyond the length of the filterbank file (due to appending). |
 ** All such events will appear in the event file for the next filterbank file.                                                   |
+**                                                                                                                               |
+** The length is either given with -l or read from the header of the filterbank file with -F. Any number of event files can be   |
+** reduced at once by listing them after the options; each is written to its name with the -x suffix added.                     |
 ------------------------------------------------------------------------------------------------------------------------------- */
 int main(int argc, char *argv[]) {
 
   int arg;
-  double MJD, time, dm, snr, width;
-  std::ifstream infile;
-  std::ofstream outfile;
+  double cutoff = 60.0;
+  const char *inFileName = NULL, *outFileName = NULL, *filFileName = NULL, *suffix = ".reduced";
+  std::vector<std::pair<std::string, std::string>> fileNames;
 
-  if (argc != 5) {
+  if (argc < 2) {
     usage();
     exit(0);
   }
 
   // Read command line parameters
-  while ((arg = getopt(argc, argv, "f:o:h")) != -1) {
+  while ((arg = getopt(argc, argv, "f:F:hl:o:x:")) != -1) {
     switch (arg) {
 
       case 'f':
-        infile.open(argv[optind - 1]);
-        if (!infile.is_open()) {
-          std::cerr << std::endl << "Error opening file " << argv[optind - 1] << " for reading!" << std::endl;
-          usage();
-          exit(0);
-        }
+        inFileName = optarg;
+        break;
+
+      case 'F':
+        filFileName = optarg;
+        break;
+
+      case 'l':
+        cutoff = atof(optarg);
         break;
 
       case 'o':
-        outfile.open(argv[optind - 1]);
-        if (!outfile.is_open()) {
-          std::cerr << std::endl << "Error opening file " << argv[optind - 1] << " for writing!" << std::endl;
-          usage();
-          exit(0);
-        }
+        outFileName = optarg;
+        break;
+
+      case 'x':
+        suffix = optarg;
         break;
 
       case 'h':
@@ -61,36 +296,36 @@ int main(int argc, char *argv[]) {
     }
   }
 
-  if (!infile.is_open()) {
-    std::cerr << "You must input a .dm file with the -f flag!" << std::endl;
-    usage();
-    exit(0);
+  // An input file given with -f needs an output file given with -o
+  if (inFileName != NULL) {
+    if (outFileName == NULL) {
+      std::cerr << "You must input an output filename with the -o flag!" << std::endl;
+      exit(0);
+    }
+    fileNames.push_back(std::make_pair(std::string(inFileName), std::string(outFileName)));
   }
 
-  if (!outfile.is_open()) {
-    std::cerr << "You must input an output filename with the -o flag!" << std::endl;
-    exit(0);
+  // Any other input files are written next to themselves, with the suffix added
+  for (int i = optind; i < argc; i++) {
+    fileNames.push_back(std::make_pair(std::string(argv[i]), std::string(argv[i]) + suffix));
   }
 
-  // Scan the first line of the input file (the start MJD of the observation) into a variable
-  infile >> MJD;
-
-  // Put the MJD in the output file
-  outfile << MJD << std::endl;
+  if (fileNames.size() == 0) {
+    std::cerr << "You must input a .dm file with the -f flag, or list .dm files after the options!" << std::endl;
+    usage();
+    exit(0);
+  }
 
-  // Read in each line from the input file
-  while (infile >> time >> dm >> snr >> width) {
-    // If the arrival time is 60 seconds or less, write it to the output file
-    if (time <= 60.0) {
-      double tempList[] = {time, dm, snr, width};
-      std::copy(tempList, tempList + 4, std::ostream_iterator<double>(outfile, " "));
-      outfile << std::endl;
+  // Take the cutoff from the length of the filterbank file, if one was given
+  if (filFileName != NULL) {
+    cutoff = filterbankLength(filFileName);
+    std::cout << "Keeping events up to " << cutoff << " s, the length of " << filFileName << std::endl;
+  }
 
+  for (const std::pair<std::string, std::string> &names : fileNames) {
+    if (reduceEventFile(names.first.c_str(), names.second.c_str(), cutoff) < 0) {
+      exit(0);
     }
   }
 
-  // Close the input and output files
-  infile.close();
-  outfile.close();
-
 }
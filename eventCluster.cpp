@@ -0,0 +1,264 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <cstdint>
+#include <getopt.h>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include "eventFile.h"
+
+// External function to print help if needed
+void usage() {
+  std::cout << std::endl << "Usage: eventCluster (-options) -f inFileName -o outFileName" << std::endl << std::endl;
+  std::cout << "     -f: Input event file, either an ASCII .dm file, an astro-accelerate binary .dat file, or a columnar event file" << std::endl;
+  std::cout << "     -o: Output ASCII cluster file" << std::endl;
+  std::cout << "     -i: Input format, ascii, aa, or evc (default = evc for columnar event files, aa for files ending in .dat, ascii otherwise)" << std::endl;
+  std::cout << "     -t: Linking length in time, in seconds (default = 0.01)" << std::endl;
+  std::cout << "     -d: Linking length in DM (default = 5.0)" << std::endl;
+  std::cout << "     -m: Minimum number of events in a cluster to write it (default = 1)" << std::endl << std::endl;
+  std::cout << "Each line of the output is the time, DM, S/N, and width of the highest S/N event in a cluster, followed by the" << std::endl;
+  std::cout << "minimum and maximum time, minimum and maximum DM, and number of events in the cluster, in order of time." << std::endl;
+  std::cout << "For ASCII and columnar input, the output starts with the MJD of the input." << std::endl << std::endl;
+}
+
+// Find the root of the cluster an event belongs to, pointing events along the way closer to it
+int findCluster(std::vector<int> &parent, int i) {
+  while (parent[i] != i) {
+    parent[i] = parent[parent[i]];
+    i = parent[i];
+  }
+  return i;
+}
+
+// Join the clusters of two events, putting the smaller under the larger
+void joinClusters(std::vector<int> &parent, std::vector<int> &size, int i, int j) {
+  i = findCluster(parent, i);
+  j = findCluster(parent, j);
+  if (i == j) {
+    return;
+  }
+  if (size[i] < size[j]) {
+    std::swap(i, j);
+  }
+  parent[j] = i;
+  size[i] += size[j];
+}
+
+// Key of the grid cell at (timeCell, dmCell)
+inline uint64_t cellKey(int64_t timeCell, int64_t dmCell) {
+  return ((uint64_t) timeCell << 32) ^ ((uint64_t) dmCell & 0xffffffff);
+}
+
+/* -- eventCluster ---------------------------------------------------------------------------------------------------------------
+** Groups single-pulse events into clusters with friends-of-friends: two events are friends if they are within -t seconds and -d |
+** DM of each other, and a cluster is every event that can be reached through friends. A bright pulse makes many events across  |
+** neighbouring DMs and widths; this writes one line for it instead.                                                            |
+**                                                                                                                               |
+** Events are put in a hash grid of cells one linking length on a side, so each event only needs to be compared with the events  |
+** in its own and the eight neighbouring cells. Clusters are joined with union-find, so the whole thing is O(n) for events that   |
+** are not packed into a few cells.                                                                                              |
+------------------------------------------------------------------------------------------------------------------------------- */
+int main(int argc, char *argv[]) {
+
+  int arg, isASCII = -1, isColumnar = -1, minMembers = 1;
+  double timeLink = 0.01, dmLink = 5.0, MJD = 0.0;
+  char *inFileName = NULL;
+  std::vector<event> events;
+  std::ofstream outfile;
+
+  if (argc < 3) {
+    usage();
+    exit(0);
+  }
+
+  // Read command line parameters
+  while ((arg = getopt(argc, argv, "d:f:hi:m:o:t:")) != -1) {
+    switch (arg) {
+
+      case 'd':
+        dmLink = atof(optarg);
+        break;
+
+      case 'f':
+        inFileName = optarg;
+        break;
+
+      case 'i':
+        if (strcmp(optarg, "ascii") == 0) {
+          isASCII = 1;
+          isColumnar = 0;
+        } else if (strcmp(optarg, "aa") == 0) {
+          isASCII = 0;
+          isColumnar = 0;
+        } else if (strcmp(optarg, "evc") == 0) {
+          isASCII = 0;
+          isColumnar = 1;
+        } else {
+          std::cerr << "Unknown input format " << optarg << "; it must be ascii, aa, or evc!" << std::endl;
+          exit(0);
+        }
+        break;
+
+      case 'm':
+        minMembers = atoi(optarg);
+        break;
+
+      case 'o':
+        outfile.open(optarg);
+        if (!outfile.is_open()) {
+          std::cerr << std::endl << "Error opening file " << optarg << " for writing!" << std::endl;
+          usage();
+          exit(0);
+        }
+        break;
+
+      case 't':
+        timeLink = atof(optarg);
+        break;
+
+      case 'h':
+        usage();
+        exit(0);
+
+      default:
+        return 0;
+        break;
+
+    }
+  }
+
+  if (inFileName == NULL) {
+    std::cerr << "You must input an event file with the -f flag!" << std::endl;
+    usage();
+    exit(0);
+  }
+
+  if (!outfile.is_open()) {
+    std::cerr << "You must input an output filename with the -o flag!" << std::endl;
+    exit(0);
+  }
+
+  if (timeLink <= 0.0 || dmLink <= 0.0) {
+    std::cerr << "Linking lengths must be positive!" << std::endl;
+    exit(0);
+  }
+
+  // Read the events, recognising a columnar event file by its header
+  if (isColumnar < 0) {
+    ColumnarEventHeader header;
+    isColumnar = readColumnarEventHeader(inFileName, header);
+    isASCII = !isColumnar && isASCIIEventFileName(inFileName);
+  }
+  if (isColumnar) {
+    if (!readColumnarEvents(inFileName, events, MJD)) {
+      std::cerr << "Could not read events from columnar event file " << inFileName << "!" << std::endl;
+      exit(0);
+    }
+  } else if (isASCII) {
+    if (!readASCIIEvents(inFileName, events, MJD)) {
+      std::cerr << "Could not read events and a start MJD from " << inFileName << "!" << std::endl;
+      exit(0);
+    }
+  } else if (!readBinaryEvents(inFileName, events)) {
+    std::cerr << "Error opening file " << inFileName << " for reading!" << std::endl;
+    exit(0);
+  }
+
+  // Drop events whose time or DM isn't a number, or is too far out to have a grid cell, as they can't be put on the grid
+  const size_t numRead = events.size();
+  events.erase(std::remove_if(events.begin(), events.end(), [timeLink, dmLink](const event &thisEvent) {
+    return !(std::abs(thisEvent.time/timeLink) < INT32_MAX && std::abs(thisEvent.dm/dmLink) < INT32_MAX);
+  }), events.end());
+  if (events.size() < numRead) {
+    std::cerr << "Dropped " << numRead - events.size() << " events with a time or DM that isn't a number or is out of range!" << std::endl;
+  }
+  const int numEvents = events.size();
+
+  // Put each event in its grid cell; the events in a cell form a linked list, starting from the cell's entry in the hash map
+  std::vector<int64_t> timeCells(numEvents), dmCells(numEvents);
+  std::vector<int> nextInCell(numEvents, -1);
+  std::unordered_map<uint64_t, int> firstInCell;
+  firstInCell.reserve(numEvents);
+  for (int i = 0; i < numEvents; i++) {
+    timeCells[i] = (int64_t) floor(events[i].time/timeLink);
+    dmCells[i] = (int64_t) floor(events[i].dm/dmLink);
+    auto cell = firstInCell.emplace(cellKey(timeCells[i], dmCells[i]), i);
+    if (!cell.second) {
+      nextInCell[i] = cell.first->second;
+      cell.first->second = i;
+    }
+  }
+
+  // Join every pair of friends, comparing each event with the events in its own and the neighbouring cells
+  // Each pair is only compared once, from the event with the lower number
+  std::vector<int> parent(numEvents), size(numEvents, 1);
+  for (int i = 0; i < numEvents; i++) {
+    parent[i] = i;
+  }
+  for (int i = 0; i < numEvents; i++) {
+    for (int timeStep = -1; timeStep <= 1; timeStep++) {
+      for (int dmStep = -1; dmStep <= 1; dmStep++) {
+        auto cell = firstInCell.find(cellKey(timeCells[i] + timeStep, dmCells[i] + dmStep));
+        if (cell == firstInCell.end()) {
+          continue;
+        }
+        for (int j = cell->second; j >= 0; j = nextInCell[j]) {
+          if (j > i && fabs(events[j].time - events[i].time) <= timeLink && fabs(events[j].dm - events[i].dm) <= dmLink) {
+            joinClusters(parent, size, i, j);
+          }
+        }
+      }
+    }
+  }
+
+  // Gather each cluster's brightest event, extent, and number of events, keeping them in order of each cluster's first event
+  struct cluster {
+    int brightest, members;
+    float timeMin, timeMax, dmMin, dmMax;
+  };
+  std::vector<cluster> clusters;
+  std::vector<int> clusterNumber(numEvents, -1);
+  for (int i = 0; i < numEvents; i++) {
+    const int root = findCluster(parent, i);
+    if (clusterNumber[root] < 0) {
+      clusterNumber[root] = clusters.size();
+      clusters.push_back({i, 0, events[i].time, events[i].time, events[i].dm, events[i].dm});
+    }
+    cluster &thisCluster = clusters[clusterNumber[root]];
+    thisCluster.members++;
+    if (events[i].snr > events[thisCluster.brightest].snr) {
+      thisCluster.brightest = i;
+    }
+    thisCluster.timeMin = std::min(thisCluster.timeMin, events[i].time);
+    thisCluster.timeMax = std::max(thisCluster.timeMax, events[i].time);
+    thisCluster.dmMin = std::min(thisCluster.dmMin, events[i].dm);
+    thisCluster.dmMax = std::max(thisCluster.dmMax, events[i].dm);
+  }
+
+  // Write the clusters in order of the time of their brightest event, starting with the MJD if the input had one
+  std::stable_sort(clusters.begin(), clusters.end(), [&events](const cluster &a, const cluster &b) { return events[a.brightest].time < events[b.brightest].time; });
+  if (isASCII || isColumnar) {
+    outfile.precision(15);
+    outfile << MJD << std::endl;
+    outfile.precision(6);
+  }
+  int numberWritten = 0;
+  for (const cluster &thisCluster : clusters) {
+    if (thisCluster.members < minMembers) {
+      continue;
+    }
+    const event &brightest = events[thisCluster.brightest];
+    outfile << brightest.time << " " << brightest.dm << " " << brightest.snr << " " << brightest.width << " " << thisCluster.timeMin << " " << thisCluster.timeMax << " " << thisCluster.dmMin << " " << thisCluster.dmMax << " " << thisCluster.members << "\n";
+    numberWritten++;
+  }
+  outfile.close();
+
+  std::cout << "Grouped " << numEvents << " events into " << clusters.size() << " clusters, and wrote " << numberWritten << " with at least " << minMembers << " events" << std::endl;
+
+  return 0;
+
+}
@@ -0,0 +1,202 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <getopt.h>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include "eventFile.h"
+
+// External function to print help if needed
+void usage() {
+  std::cout << std::endl << "Usage: eventConvert (-options) -f inFileName -o outFileName" << std::endl;
+  std::cout << "       eventConvert -H column (-n bins) -f columnarFileName" << std::endl << std::endl;
+  std::cout << "     -f: Input event file, either an ASCII .dm file or an astro-accelerate binary .dat file" << std::endl;
+  std::cout << "     -o: Output columnar event file" << std::endl;
+  std::cout << "     -i: Input format, ascii or aa (default = aa for files ending in .dat, ascii otherwise)" << std::endl;
+  std::cout << "     -a: Append the events to an existing columnar event file instead of starting a new one" << std::endl;
+  std::cout << "     -m: Start MJD of an astro-accelerate file, which doesn't record it (default = 0, or the MJD of the file being appended to)" << std::endl;
+  std::cout << "     -b: Beam number to record in a new file (default = -1, unknown)" << std::endl;
+  std::cout << "     -c: Number of events per chunk (default = 1048576)" << std::endl;
+  std::cout << "     -H: Only print a histogram of one column (dm, time, snr, or width) of the columnar event file given with -f" << std::endl;
+  std::cout << "     -n: Number of bins in the histogram (default = 20)" << std::endl << std::endl;
+  std::cout << "When appending, the times of events from an input with a different start MJD are moved onto the timeline of the output file." << std::endl;
+  std::cout << "A histogram reads only that column of the file, and prints the lower and upper edge and number of events of each bin." << std::endl << std::endl;
+}
+
+/* -- eventConvert ----------------------------------------------------------------------------------------------------------
+** Converts single-pulse events from an ASCII .dm file (start MJD, then time, DM, S/N, and width on each line) or from an   |
+** astro-accelerate binary file into the columnar event format described in eventFile.h, or appends them to such a file.   |
+** With -H, it instead prints a histogram of one column of a columnar event file, reading only that column.                  |
+-------------------------------------------------------------------------------------------------------------------------- */
+int main(int argc, char *argv[]) {
+
+  int arg, append = 0, beam = -1, isASCII = -1, haveMJD = 0, numBins = 20;
+  size_t chunkSize = 1 << 20;
+  double MJD = 0.0, timeOffset = 0.0;
+  char *inFileName = NULL, *outFileName = NULL, *histogramColumn = NULL;
+  std::vector<event> events;
+  ColumnarEventHeader header;
+
+  if (argc < 3) {
+    usage();
+    exit(0);
+  }
+
+  // Read command line parameters
+  while ((arg = getopt(argc, argv, "ab:c:f:H:hi:m:n:o:")) != -1) {
+    switch (arg) {
+
+      case 'a':
+        append = 1;
+        break;
+
+      case 'b':
+        beam = atoi(optarg);
+        break;
+
+      case 'c':
+        if (atol(optarg) < 1) {
+          std::cerr << "Chunks must hold at least one event! Defaulting to 1048576!" << std::endl;
+        } else {
+          chunkSize = atol(optarg);
+        }
+        break;
+
+      case 'f':
+        inFileName = optarg;
+        break;
+
+      case 'H':
+        histogramColumn = optarg;
+        break;
+
+      case 'i':
+        if (strcmp(optarg, "ascii") == 0) {
+          isASCII = 1;
+        } else if (strcmp(optarg, "aa") == 0) {
+          isASCII = 0;
+        } else {
+          std::cerr << "Unknown input format " << optarg << "; it must be ascii or aa!" << std::endl;
+          exit(0);
+        }
+        break;
+
+      case 'm':
+        MJD = atof(optarg);
+        haveMJD = 1;
+        break;
+
+      case 'n':
+        if (atoi(optarg) < 1) {
+          std::cerr << "A histogram must have at least one bin! Defaulting to 20!" << std::endl;
+        } else {
+          numBins = atoi(optarg);
+        }
+        break;
+
+      case 'o':
+        outFileName = optarg;
+        break;
+
+      case 'h':
+        usage();
+        exit(0);
+
+      default:
+        return 0;
+        break;
+
+    }
+  }
+
+  if (inFileName == NULL) {
+    std::cerr << "You must input an event file with the -f flag!" << std::endl;
+    usage();
+    exit(0);
+  }
+
+  // Only print a histogram of one column, which is the only part of the file read
+  if (histogramColumn != NULL) {
+    std::vector<float> values;
+    if (!readColumnarEventColumn(inFileName, histogramColumn, values)) {
+      std::cerr << "Could not read column " << histogramColumn << " from columnar event file " << inFileName << "; it must be dm, time, snr, or width!" << std::endl;
+      exit(0);
+    }
+    values.erase(std::remove_if(values.begin(), values.end(), [](float value) { return !std::isfinite(value); }), values.end());
+    if (values.size() == 0) {
+      std::cerr << "No events in " << inFileName << "!" << std::endl;
+      exit(0);
+    }
+    const auto range = std::minmax_element(values.begin(), values.end());
+    const double low = *range.first, binWidth = (*range.second - low)/numBins;
+    std::vector<size_t> counts(numBins, 0);
+    for (float value : values) {
+      counts[binWidth > 0 ? std::min(numBins - 1, (int) ((value - low)/binWidth)) : 0]++;
+    }
+    for (int bin = 0; bin < numBins; bin++) {
+      std::cout << low + bin * binWidth << " " << low + (bin + 1) * binWidth << " " << counts[bin] << std::endl;
+    }
+    return 0;
+  }
+
+  if (outFileName == NULL) {
+    std::cerr << "You must input an output filename with the -o flag!" << std::endl;
+    exit(0);
+  }
+
+  // Guess the input format from the file name if it wasn't given
+  if (isASCII < 0) {
+    isASCII = isASCIIEventFileName(inFileName);
+  }
+
+  // When appending, the output file must already be a columnar event file
+  if (append && !readColumnarEventHeader(outFileName, header)) {
+    std::cerr << outFileName << " is not a columnar event file, so can't be appended to!" << std::endl;
+    exit(0);
+  }
+
+  // Read the events; only an ASCII file records its start MJD
+  if (isASCII) {
+    if (!readASCIIEvents(inFileName, events, MJD)) {
+      std::cerr << "Could not read events and a start MJD from " << inFileName << "!" << std::endl;
+      exit(0);
+    }
+    haveMJD = 1;
+  } else if (!readBinaryEvents(inFileName, events)) {
+    std::cerr << "Error opening file " << inFileName << " for reading!" << std::endl;
+    exit(0);
+  }
+
+  if (append) {
+    // Move the events onto the timeline of the file being appended to
+    if (haveMJD && MJD != header.MJD) {
+      timeOffset = (MJD - header.MJD) * 86400.0;
+      for (event &thisEvent : events) {
+        thisEvent.time += timeOffset;
+      }
+    }
+  } else if (!createColumnarEventFile(outFileName, inFileName, MJD, beam)) {
+    std::cerr << "Could not open file " << outFileName << " to write!" << std::endl;
+    exit(0);
+  }
+
+  // Write the events in chunks
+  for (size_t first = 0; first < events.size(); first += chunkSize) {
+    if (!appendColumnarEvents(outFileName, &events[first], std::min(chunkSize, events.size() - first))) {
+      std::cerr << "Error writing events to " << outFileName << "!" << std::endl;
+      exit(0);
+    }
+  }
+
+  std::cout << (append ? "Appended " : "Wrote ") << events.size() << " events from " << inFileName << " to " << outFileName;
+  if (timeOffset != 0.0) {
+    std::cout << ", moved by " << timeOffset << " s";
+  }
+  std::cout << std::endl;
+
+  return 0;
+
+}
@@ -0,0 +1,442 @@
+#ifndef EVENTFILE_H
+#define EVENTFILE_H
+
+#include <cstring>
+#include <cmath>
+#include <cctype>
+#include <cstdint>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <charconv>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+/* -- eventFile ------------------------------------------------------------------------------------------------
+** Single-pulse events as written by astro-accelerate: a flat binary file of {DM, time, S/N, width} floats.    |
+**                                                                                                             |
+** A time-sorted event file can have a sidecar index (the event file name with ".idx" appended), which splits  |
+** the events into fixed-size blocks and stores the range of time, DM, S/N, and width in each. A range query   |
+** only needs to read the blocks whose ranges overlap it. The index records the size and modification time of  |
+** the event file, and is ignored if either has changed. Written by eventIndex, used by plotEvents.            |
+**                                                                                                             |
+** Events can also be stored in a columnar file (written by eventConvert): a fixed-size header describing the  |
+** source file, start MJD, beam, and columns, followed by chunks of events, each holding the number of events  |
+** in it and then all the values of each column in turn. Reading one column only touches that column's bytes,  |
+** and appending only adds a chunk and updates the counts in the header. Read by eventCluster, and one column  |
+** at a time by eventConvert -H.                                                                               |
+------------------------------------------------------------------------------------------------------------- */
+
+struct event {
+  float dm, time, snr, width;
+};
+
+// Whether an event file is ASCII (a .dm file) rather than astro-accelerate binary, going by its name (binary files end in .dat)
+inline bool isASCIIEventFileName(const char *fileName) {
+  const size_t nameLength = strlen(fileName);
+  return !(nameLength >= 4 && strcmp(fileName + nameLength - 4, ".dat") == 0);
+}
+
+// Read all the events in an ASCII event file: the start MJD, then the time, DM, S/N, and width of each event
+// The whole file is read at once and parsed in place; parsing stops at the first thing that isn't a number
+// Returns 1 on success, 0 if the file can't be read or doesn't start with an MJD
+inline int readASCIIEvents(const char *fileName, std::vector<event> &events, double &MJD) {
+
+  std::ifstream file(fileName, std::ifstream::binary);
+  std::stringstream contents;
+  float values[4];
+  int numberOfValues = -1;
+
+  if (!file.is_open()) {
+    return 0;
+  }
+  contents << file.rdbuf();
+  const std::string text = contents.str();
+
+  events.clear();
+  const char *position = text.data(), *end = text.data() + text.size();
+  while (true) {
+    while (position < end && isspace((unsigned char) *position)) {
+      position++;
+    }
+    if (position == end) {
+      break;
+    }
+    const char *tokenEnd = position;
+    while (tokenEnd < end && !isspace((unsigned char) *tokenEnd)) {
+      tokenEnd++;
+    }
+    if (numberOfValues < 0) {
+      if (std::from_chars(position, tokenEnd, MJD).ec != std::errc()) {
+        return 0;
+      }
+      numberOfValues = 0;
+    } else {
+      if (std::from_chars(position, tokenEnd, values[numberOfValues]).ec != std::errc()) {
+        break;
+      }
+      if (++numberOfValues == 4) {
+        events.push_back({values[1], values[0], values[2], values[3]});
+        numberOfValues = 0;
+      }
+    }
+    position = tokenEnd;
+  }
+
+  return numberOfValues >= 0 ? 1 : 0;
+
+}
+
+// Read all the events in an astro-accelerate binary event file
+// Returns 1 on success, 0 if the file can't be read
+inline int readBinaryEvents(const char *fileName, std::vector<event> &events) {
+
+  struct stat fileStatus;
+  int fileDescriptor = open(fileName, O_RDONLY);
+
+  if (fileDescriptor < 0) {
+    return 0;
+  }
+
+  fstat(fileDescriptor, &fileStatus);
+  const size_t numberOfEvents = fileStatus.st_size/sizeof(event);
+  events.clear();
+  if (numberOfEvents > 0) {
+    void *mappedFile = mmap(NULL, numberOfEvents * sizeof(event), PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+    if (mappedFile == MAP_FAILED) {
+      close(fileDescriptor);
+      return 0;
+    }
+    events.assign((const event*) mappedFile, (const event*) mappedFile + numberOfEvents);
+    munmap(mappedFile, numberOfEvents * sizeof(event));
+  }
+  close(fileDescriptor);
+
+  return 1;
+
+}
+
+// Summary of one block of events in an index
+struct eventBlock {
+  uint64_t firstEvent;
+  uint32_t numEvents;
+  float timeMin, timeMax, dmMin, dmMax, snrMin, snrMax, widthMin, widthMax;
+};
+
+struct EventIndex {
+  uint32_t blockSize;
+  uint64_t numEvents;
+  // Size and modification time of the event file when it was indexed
+  uint64_t fileSize;
+  int64_t modifiedSeconds, modifiedNanoseconds;
+  std::vector<eventBlock> blocks;
+};
+
+// Identifies an event index file
+const char eventIndexMagic[8] = {'E', 'V', 'I', 'D', 'X', '0', '0', '2'};
+
+// The name of the index for an event file
+inline std::string eventIndexFileName(const char *eventFileName) {
+  return std::string(eventFileName) + ".idx";
+}
+
+// Fill in an index of 'numEvents' events, split into blocks of 'blockSize'
+inline void computeEventIndex(EventIndex &index, const event *events, size_t numEvents, uint32_t blockSize) {
+
+  index.blockSize = blockSize;
+  index.numEvents = numEvents;
+  index.blocks.clear();
+
+  for (size_t first = 0; first < numEvents; first += blockSize) {
+    eventBlock block;
+    block.firstEvent = first;
+    block.numEvents = std::min((size_t) blockSize, numEvents - first);
+    block.timeMin = block.dmMin = block.snrMin = block.widthMin = INFINITY;
+    block.timeMax = block.dmMax = block.snrMax = block.widthMax = -INFINITY;
+    for (size_t i = first; i < first + block.numEvents; i++) {
+      block.timeMin = std::min(block.timeMin, events[i].time);
+      block.timeMax = std::max(block.timeMax, events[i].time);
+      block.dmMin = std::min(block.dmMin, events[i].dm);
+      block.dmMax = std::max(block.dmMax, events[i].dm);
+      block.snrMin = std::min(block.snrMin, events[i].snr);
+      block.snrMax = std::max(block.snrMax, events[i].snr);
+      block.widthMin = std::min(block.widthMin, events[i].width);
+      block.widthMax = std::max(block.widthMax, events[i].width);
+    }
+    index.blocks.push_back(block);
+  }
+
+}
+
+// Record the size and modification time of an event file in its index, so a later change to the file can be noticed
+// Returns 1 on success, 0 if the event file can't be found
+inline int stampEventIndex(EventIndex &index, const char *eventFileName) {
+  struct stat fileStatus;
+  if (stat(eventFileName, &fileStatus) != 0) {
+    return 0;
+  }
+  index.fileSize = fileStatus.st_size;
+  index.modifiedSeconds = fileStatus.st_mtim.tv_sec;
+  index.modifiedNanoseconds = fileStatus.st_mtim.tv_nsec;
+  return 1;
+}
+
+// Write the index of an event file, next to it
+// Returns 1 on success, 0 otherwise
+inline int saveEventIndex(const EventIndex &index, const char *eventFileName) {
+
+  std::ofstream file(eventIndexFileName(eventFileName), std::ofstream::binary);
+
+  if (!file.is_open()) {
+    return 0;
+  }
+
+  file.write(eventIndexMagic, sizeof(eventIndexMagic));
+  file.write((char*) &index.blockSize, sizeof(uint32_t));
+  file.write((char*) &index.numEvents, sizeof(uint64_t));
+  file.write((char*) &index.fileSize, sizeof(uint64_t));
+  file.write((char*) &index.modifiedSeconds, sizeof(int64_t));
+  file.write((char*) &index.modifiedNanoseconds, sizeof(int64_t));
+  if (index.blocks.size() > 0) {
+    file.write((char*) &index.blocks[0], sizeof(eventBlock) * index.blocks.size());
+  }
+
+  return file ? 1 : 0;
+
+}
+
+// Read the index of an event file of 'numEvents' events, but only if the event file has the size and modification time it had when
+// it was indexed (otherwise it has been changed or rewritten since, and the index may describe other events)
+// Returns 1 if the index was loaded, 0 if the index is missing, unreadable, or out of date
+inline int loadEventIndex(EventIndex &index, const char *eventFileName, size_t numEvents) {
+
+  char magic[sizeof(eventIndexMagic)];
+  EventIndex eventFileStamp;
+  std::ifstream file(eventIndexFileName(eventFileName), std::ifstream::binary);
+
+  if (!file.is_open() || !stampEventIndex(eventFileStamp, eventFileName)) {
+    return 0;
+  }
+
+  file.read(magic, sizeof(magic));
+  file.read((char*) &index.blockSize, sizeof(uint32_t));
+  file.read((char*) &index.numEvents, sizeof(uint64_t));
+  file.read((char*) &index.fileSize, sizeof(uint64_t));
+  file.read((char*) &index.modifiedSeconds, sizeof(int64_t));
+  file.read((char*) &index.modifiedNanoseconds, sizeof(int64_t));
+  if (!file || memcmp(magic, eventIndexMagic, sizeof(magic)) != 0 || index.blockSize == 0 || index.numEvents != numEvents ||
+      index.fileSize != eventFileStamp.fileSize || index.modifiedSeconds != eventFileStamp.modifiedSeconds || index.modifiedNanoseconds != eventFileStamp.modifiedNanoseconds) {
+    return 0;
+  }
+
+  index.blocks.resize((numEvents + index.blockSize - 1)/index.blockSize);
+  if (index.blocks.size() > 0) {
+    file.read((char*) &index.blocks[0], sizeof(eventBlock) * index.blocks.size());
+  }
+
+  return file ? 1 : 0;
+
+}
+
+// Identifies a columnar event file
+const char columnarEventMagic[8] = {'E', 'V', 'C', 'O', 'L', '0', '0', '1'};
+
+// The columns of a columnar event file, in the order they are stored in each chunk
+const int numEventColumns = 4;
+const char eventColumnNames[numEventColumns][16] = {"dm", "time", "snr", "width"};
+
+struct ColumnarEventHeader {
+  char magic[8];
+  char sourceFile[256];
+  double MJD;
+  int32_t beam; // -1 if not known
+  uint32_t numColumns;
+  char columnNames[numEventColumns][16];
+  uint64_t numEvents, numChunks;
+  uint64_t dataLength; // Bytes of chunks after the header
+};
+
+// Start a columnar event file with no events
+// Returns 1 on success, 0 otherwise
+inline int createColumnarEventFile(const char *fileName, const char *sourceFile, double MJD, int beam) {
+
+  ColumnarEventHeader header;
+  std::ofstream file(fileName, std::ofstream::binary);
+
+  if (!file.is_open()) {
+    return 0;
+  }
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, columnarEventMagic, sizeof(columnarEventMagic));
+  strncpy(header.sourceFile, sourceFile, sizeof(header.sourceFile) - 1);
+  header.MJD = MJD;
+  header.beam = beam;
+  header.numColumns = numEventColumns;
+  memcpy(header.columnNames, eventColumnNames, sizeof(eventColumnNames));
+  file.write((char*) &header, sizeof(header));
+
+  return file ? 1 : 0;
+
+}
+
+// Read the header of a columnar event file
+// Returns 1 on success, 0 if the file is missing, unreadable, or not a columnar event file
+inline int readColumnarEventHeader(const char *fileName, ColumnarEventHeader &header) {
+
+  std::ifstream file(fileName, std::ifstream::binary);
+
+  if (!file.is_open()) {
+    return 0;
+  }
+
+  file.read((char*) &header, sizeof(header));
+  if (!file || memcmp(header.magic, columnarEventMagic, sizeof(columnarEventMagic)) != 0 || header.numColumns != numEventColumns) {
+    return 0;
+  }
+
+  return 1;
+
+}
+
+// Append 'numEvents' events to a columnar event file as one chunk, and add them to the counts in the header
+// Returns 1 on success, 0 otherwise
+inline int appendColumnarEvents(const char *fileName, const event *events, size_t numEvents) {
+
+  ColumnarEventHeader header;
+  std::vector<float> column(numEvents);
+  uint64_t chunkEvents = numEvents;
+
+  if (!readColumnarEventHeader(fileName, header)) {
+    return 0;
+  }
+  if (numEvents == 0) {
+    return 1;
+  }
+
+  std::fstream file(fileName, std::fstream::in | std::fstream::out | std::fstream::binary);
+  if (!file.is_open()) {
+    return 0;
+  }
+
+  // Write the chunk after the last complete one (anything after that is left over from a failed append), one column at a time
+  file.seekp(sizeof(header) + header.dataLength, file.beg);
+  file.write((char*) &chunkEvents, sizeof(uint64_t));
+  for (int columnNumber = 0; columnNumber < numEventColumns; columnNumber++) {
+    for (size_t i = 0; i < numEvents; i++) {
+      column[i] = ((const float*) &events[i])[columnNumber];
+    }
+    file.write((char*) &column[0], sizeof(float) * numEvents);
+  }
+
+  // Only update the counts once the whole chunk is written, so a failed append leaves the file readable
+  file.flush();
+  if (!file) {
+    return 0;
+  }
+  header.numEvents += numEvents;
+  header.numChunks++;
+  header.dataLength += sizeof(uint64_t) + sizeof(float) * numEventColumns * numEvents;
+  file.seekp(0, file.beg);
+  file.write((char*) &header, sizeof(header));
+
+  return file ? 1 : 0;
+
+}
+
+// Read the columns of a columnar event file marked in 'wanted' into 'columns', in one pass over the file that seeks over the other columns
+// Returns 1 on success, 0 if the file can't be read or isn't a columnar event file
+inline int readColumnarEventColumns(const char *fileName, ColumnarEventHeader &header, const bool wanted[numEventColumns], std::vector<float> columns[numEventColumns]) {
+
+  std::ifstream file(fileName, std::ifstream::binary);
+  uint64_t chunkEvents;
+
+  if (!file.is_open()) {
+    return 0;
+  }
+  file.read((char*) &header, sizeof(header));
+  if (!file || memcmp(header.magic, columnarEventMagic, sizeof(columnarEventMagic)) != 0 || header.numColumns != numEventColumns ||
+      memcmp(header.columnNames, eventColumnNames, sizeof(eventColumnNames)) != 0) {
+    return 0;
+  }
+  for (int column = 0; column < numEventColumns; column++) {
+    columns[column].resize(wanted[column] ? header.numEvents : 0);
+  }
+
+  size_t eventsRead = 0;
+  for (uint64_t chunk = 0; chunk < header.numChunks; chunk++) {
+    file.read((char*) &chunkEvents, sizeof(uint64_t));
+    if (!file || eventsRead + chunkEvents > header.numEvents) {
+      return 0;
+    }
+    for (int column = 0; column < numEventColumns; column++) {
+      if (wanted[column]) {
+        file.read((char*) &columns[column][eventsRead], sizeof(float) * chunkEvents);
+      } else {
+        file.seekg(sizeof(float) * chunkEvents, file.cur);
+      }
+    }
+    eventsRead += chunkEvents;
+  }
+
+  return file && eventsRead == header.numEvents ? 1 : 0;
+
+}
+
+// Read all the values of one column (by name) of a columnar event file, skipping over the other columns
+// Returns 1 on success, 0 if the file can't be read or has no such column
+inline int readColumnarEventColumn(const char *fileName, const char *columnName, std::vector<float> &values) {
+
+  ColumnarEventHeader header;
+  std::vector<float> columns[numEventColumns];
+  bool wanted[numEventColumns] = {false};
+  int columnNumber = -1;
+
+  // readColumnarEventColumns checks that the file's columns are stored in the order of eventColumnNames
+  for (int i = 0; i < numEventColumns; i++) {
+    if (strncmp(eventColumnNames[i], columnName, sizeof(eventColumnNames[i])) == 0) {
+      columnNumber = i;
+    }
+  }
+  if (columnNumber < 0) {
+    return 0;
+  }
+  wanted[columnNumber] = true;
+
+  if (!readColumnarEventColumns(fileName, header, wanted, columns)) {
+    return 0;
+  }
+  values.swap(columns[columnNumber]);
+
+  return 1;
+
+}
+
+// Read all the events in a columnar event file, in one pass over it, and the start MJD from its header
+// Returns 1 on success, 0 if the file can't be read or isn't a columnar event file
+inline int readColumnarEvents(const char *fileName, std::vector<event> &events, double &MJD) {
+
+  ColumnarEventHeader header;
+  std::vector<float> columns[numEventColumns];
+  const bool wanted[numEventColumns] = {true, true, true, true};
+
+  if (!readColumnarEventColumns(fileName, header, wanted, columns)) {
+    return 0;
+  }
+  MJD = header.MJD;
+
+  // The columns are stored in the same order as the fields of an event
+  events.resize(header.numEvents);
+  for (size_t i = 0; i < events.size(); i++) {
+    events[i] = {columns[0][i], columns[1][i], columns[2][i], columns[3][i]};
+  }
+
+  return 1;
+
+}
+
+#endif
@@ -0,0 +1,157 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <getopt.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include "eventFile.h"
+
+// External function to print help if needed
+void usage() {
+  std::cout << std::endl << "Usage: eventIndex (-options) -f dat_file" << std::endl << std::endl;
+  std::cout << "     -f: Input .dat file" << std::endl;
+  std::cout << "     -o: Output .dat file, sorted by time (default = index the input file, which must already be sorted by time)" << std::endl;
+  std::cout << "     -b: Number of events per index block (default = 4096)" << std::endl << std::endl;
+  std::cout << "The index is written next to the (output) .dat file, with .idx appended to its name." << std::endl << std::endl;
+}
+
+/* -- eventIndex -----------------------------------------------------------------------------------------------------
+** Sorts an astro-accelerate event file by time and writes a block index for it (see eventFile.h), so plotEvents can |
+** zoom into a small time, DM, or S/N range of a large event file without reading all of it.                          |
+------------------------------------------------------------------------------------------------------------------- */
+int main(int argc, char *argv[]) {
+
+  int arg, fileDescriptor = -1;
+  uint32_t blockSize = 4096;
+  char *inputFileName = NULL, *outputFileName = NULL;
+  struct stat fileStatus;
+  EventIndex index;
+
+  if (argc < 3) {
+    usage();
+    exit(0);
+  }
+
+  // Read command line parameters
+  while ((arg = getopt(argc, argv, "b:f:ho:")) != -1) {
+    switch (arg) {
+
+      case 'b':
+        if (atoi(optarg) < 1) {
+          std::cerr << "Index blocks must contain at least one event! Defaulting to 4096!" << std::endl;
+        } else {
+          blockSize = atoi(optarg);
+        }
+        break;
+
+      case 'f':
+        inputFileName = optarg;
+        break;
+
+      case 'o':
+        outputFileName = optarg;
+        break;
+
+      case 'h':
+        usage();
+        exit(0);
+
+      default:
+        return 0;
+        break;
+
+    }
+  }
+
+  if (inputFileName == NULL) {
+    std::cerr << "You must input a .dat file with the -f flag!" << std::endl;
+    usage();
+    exit(0);
+  }
+
+  fileDescriptor = open(inputFileName, O_RDONLY);
+  if (fileDescriptor < 0) {
+    std::cerr << "Error opening file " << inputFileName << std::endl;
+    exit(0);
+  }
+
+  // Determine how many events there are from the size of the file, and map it into memory
+  fstat(fileDescriptor, &fileStatus);
+  const size_t numberOfEvents = fileStatus.st_size/sizeof(event);
+  if (numberOfEvents < 1) {
+    std::cerr << "No events in file " << inputFileName << "!" << std::endl;
+    close(fileDescriptor);
+    exit(0);
+  }
+  void *mappedFile = mmap(NULL, numberOfEvents * sizeof(event), PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+  if (mappedFile == MAP_FAILED) {
+    std::cerr << "Could not map the event file into memory!" << std::endl;
+    close(fileDescriptor);
+    exit(0);
+  }
+  madvise(mappedFile, numberOfEvents * sizeof(event), MADV_SEQUENTIAL);
+  const event *events = (const event*) mappedFile;
+
+  // Check whether the events are already in time order
+  bool isSorted = true;
+  for (size_t i = 1; i < numberOfEvents && isSorted; i++) {
+    isSorted = events[i].time >= events[i - 1].time;
+  }
+
+  if (outputFileName == NULL) {
+
+    // Index the input file as it is, which is only useful if it is sorted
+    if (!isSorted) {
+      std::cerr << inputFileName << " is not sorted by time; give an output file with -o to write a sorted copy!" << std::endl;
+      munmap(mappedFile, numberOfEvents * sizeof(event));
+      close(fileDescriptor);
+      exit(0);
+    }
+    computeEventIndex(index, events, numberOfEvents, blockSize);
+    outputFileName = inputFileName;
+
+  } else {
+
+    // Copy the events, sort them by time (keeping the original order of events at the same time), and write them out
+    std::vector<event> sortedEvents(events, events + numberOfEvents);
+    if (!isSorted) {
+      std::stable_sort(sortedEvents.begin(), sortedEvents.end(), [](const event &a, const event &b) { return a.time < b.time; });
+    }
+
+    std::ofstream outputFile(outputFileName, std::ofstream::binary);
+    if (!outputFile.is_open()) {
+      std::cerr << "Could not open file " << outputFileName << " to write!" << std::endl;
+      exit(0);
+    }
+    outputFile.write((char*) &sortedEvents[0], sizeof(event) * numberOfEvents);
+    if (!outputFile) {
+      std::cerr << "Error writing events to " << outputFileName << "!" << std::endl;
+      exit(0);
+    }
+    outputFile.close();
+
+    computeEventIndex(index, &sortedEvents[0], numberOfEvents, blockSize);
+
+  }
+
+  munmap(mappedFile, numberOfEvents * sizeof(event));
+  close(fileDescriptor);
+
+  // Write the index next to the event file it describes, recording the size and modification time of the file as it is now
+  const std::string indexFileName = eventIndexFileName(outputFileName);
+  if (!stampEventIndex(index, outputFileName) || !saveEventIndex(index, outputFileName)) {
+    std::cerr << "Could not write index file " << indexFileName << "!" << std::endl;
+    exit(0);
+  }
+
+  std::cout << "Indexed " << numberOfEvents << " events in " << index.blocks.size() << " blocks of " << blockSize << " in " << indexFileName << std::endl;
+
+  return 0;
+
+}
@@ -0,0 +1,212 @@
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <cstdlib>
+#include <getopt.h>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <queue>
+#include <functional>
+#include <algorithm>
+
+// External function to print help if needed
+void usage() {
+  std::cout << std::endl << "Usage: eventMerge (-options) -o outFileName inFileName1 inFileName2 ..." << std::endl << std::endl;
+  std::cout << "     -o: Output ASCII event file" << std::endl;
+  std::cout << "     -t: Maximum difference in time for two events to be the same event, in seconds (default = 0.005)" << std::endl;
+  std::cout << "     -d: Maximum difference in DM for two events to be the same event (default = 1.0)" << std::endl;
+  std::cout << "     -s: Add a fifth column with the number of the input file each event came from (counting from 0)" << std::endl << std::endl;
+  std::cout << "Each input file is an ASCII event file whose first line is its start MJD, followed by time, DM, S/N, and width on each line, sorted by time." << std::endl;
+  std::cout << "The output has the same format, starting at the earliest MJD of the inputs." << std::endl << std::endl;
+}
+
+// One event on the merged timeline
+struct mergeEvent {
+  double time, dm, snr, width;
+  int source;
+  bool dropped;
+};
+
+/* -- eventMerge ------------------------------------------------------------------------------------------------------------------
+** Merges any number of time-sorted ASCII event files, from consecutive (overlapping) segments and/or different beams, into one   |
+** time-sorted file, with times measured from the earliest start MJD.                                                            |
+**                                                                                                                                |
+** The files are merged as streams through a heap holding the next event of each file, so memory use does not depend on the size |
+** of the files. Events from different files that are within -t seconds and -d DM of each other are treated as one event (as     |
+** happens in the overlap that filAppender adds between segments), and only the one with the highest S/N is kept. Only events    |
+** within -t seconds of the newest event are held while looking for matches.                                                     |
+-------------------------------------------------------------------------------------------------------------------------------- */
+int main(int argc, char *argv[]) {
+
+  int arg, writeSource = 0;
+  double timeTolerance = 0.005, dmTolerance = 1.0, startMJD = INFINITY;
+  long long numberRead = 0, numberWritten = 0;
+  std::ofstream outfile;
+
+  if (argc < 4) {
+    usage();
+    exit(0);
+  }
+
+  // Read command line parameters
+  while ((arg = getopt(argc, argv, "d:ho:st:")) != -1) {
+    switch (arg) {
+
+      case 'd':
+        dmTolerance = atof(optarg);
+        break;
+
+      case 'o':
+        outfile.open(optarg);
+        if (!outfile.is_open()) {
+          std::cerr << std::endl << "Error opening file " << optarg << " for writing!" << std::endl;
+          usage();
+          exit(0);
+        }
+        break;
+
+      case 's':
+        writeSource = 1;
+        break;
+
+      case 't':
+        timeTolerance = atof(optarg);
+        break;
+
+      case 'h':
+        usage();
+        exit(0);
+
+      default:
+        return 0;
+        break;
+
+    }
+  }
+
+  if (!outfile.is_open()) {
+    std::cerr << "You must input an output filename with the -o flag!" << std::endl;
+    exit(0);
+  }
+
+  // The remaining arguments are the input files
+  const int numSources = argc - optind;
+  if (numSources < 1) {
+    std::cerr << "You must give at least one input file!" << std::endl;
+    usage();
+    exit(0);
+  }
+
+  // Open every input file and read its start MJD (the first line)
+  std::vector<std::ifstream> infiles(numSources);
+  std::vector<double> MJDs(numSources), timeOffsets(numSources), lastTimes(numSources, -INFINITY);
+  for (int source = 0; source < numSources; source++) {
+    infiles[source].open(argv[optind + source]);
+    if (!infiles[source].is_open()) {
+      std::cerr << std::endl << "Error opening file " << argv[optind + source] << " for reading!" << std::endl;
+      exit(0);
+    }
+    if (!(infiles[source] >> MJDs[source])) {
+      std::cerr << "Could not read the start MJD of " << argv[optind + source] << "!" << std::endl;
+      exit(0);
+    }
+    startMJD = std::min(startMJD, MJDs[source]);
+  }
+
+  // Times in each file are moved onto one timeline starting at the earliest MJD
+  for (int source = 0; source < numSources; source++) {
+    timeOffsets[source] = (MJDs[source] - startMJD) * 86400.0;
+  }
+
+  // Read the next event of a file onto the merged timeline, checking the file is in time order
+  // Returns 1 if an event was read, 0 at the end of the file
+  std::vector<mergeEvent> nextEvents(numSources);
+  auto readNextEvent = [&](int source) {
+    mergeEvent &next = nextEvents[source];
+    if (!(infiles[source] >> next.time >> next.dm >> next.snr >> next.width)) {
+      return 0;
+    }
+    if (next.time < lastTimes[source]) {
+      std::cerr << argv[optind + source] << " is not sorted by time (an event at " << next.time << " s follows one at " << lastTimes[source] << " s)!" << std::endl;
+      exit(0);
+    }
+    lastTimes[source] = next.time;
+    next.time += timeOffsets[source];
+    next.source = source;
+    next.dropped = false;
+    numberRead++;
+    return 1;
+  };
+
+  // The heap holds the time of the next event of each file that has not ended, earliest first (ties go to the lower file number)
+  std::priority_queue<std::pair<double, int>, std::vector<std::pair<double, int>>, std::greater<std::pair<double, int>>> heap;
+  for (int source = 0; source < numSources; source++) {
+    if (readNextEvent(source)) {
+      heap.push(std::make_pair(nextEvents[source].time, source));
+    }
+  }
+
+  // Write the start MJD at full precision, and keep enough digits in the times for long merged timelines
+  outfile.precision(15);
+  outfile << startMJD << std::endl;
+  outfile.precision(10);
+
+  // Events that might still match a later event, in time order
+  std::deque<mergeEvent> pending;
+  auto writeEvent = [&](const mergeEvent &event) {
+    if (!event.dropped) {
+      outfile << event.time << " " << event.dm << " " << event.snr << " " << event.width << " ";
+      if (writeSource) {
+        outfile << event.source << " ";
+      }
+      outfile << "\n";
+      numberWritten++;
+    }
+  };
+
+  while (!heap.empty()) {
+
+    // Take the earliest event of all the files, and replace it in the heap with the next event from the same file
+    const int source = heap.top().second;
+    heap.pop();
+    mergeEvent event = nextEvents[source];
+    if (readNextEvent(source)) {
+      heap.push(std::make_pair(nextEvents[source].time, source));
+    }
+
+    // Events more than the time tolerance before this one can't match it or anything after it, so they are final
+    while (!pending.empty() && pending.front().time < event.time - timeTolerance) {
+      writeEvent(pending.front());
+      pending.pop_front();
+    }
+
+    // Look for the same event in a different file; of the two, keep the one with the highest S/N
+    for (mergeEvent &previous : pending) {
+      if (!previous.dropped && previous.source != event.source && fabs(previous.dm - event.dm) <= dmTolerance) {
+        if (event.snr > previous.snr) {
+          previous.dropped = true;
+        } else {
+          event.dropped = true;
+          break;
+        }
+      }
+    }
+
+    pending.push_back(event);
+
+  }
+
+  // Everything left is final
+  for (const mergeEvent &event : pending) {
+    writeEvent(event);
+  }
+
+  outfile.close();
+
+  std::cout << "Merged " << numberRead << " events from " << numSources << " files into " << numberWritten << " events" << std::endl;
+
+  return 0;
+
+}
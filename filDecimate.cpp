@@ -0,0 +1,598 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <cstdint>
+#include <getopt.h>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+
+// External function to print help if needed
+void usage() {
+  std::cout << std::endl << "Usage: filDecimate (-options) -f filFile -o outputFile" << std::endl << std::endl;
+  std::cout << "     -f: Input .fil file" << std::endl;
+  std::cout << "     -o: Output .fil file" << std::endl;
+  std::cout << "     -t: Number of time samples to add together (default = 1)" << std::endl;
+  std::cout << "     -c: Number of channels to add together (default = 1)" << std::endl;
+  std::cout << "     -b: Number of bits per output sample, 1, 2, 4, 8, 16, or 32 (default = input number of bits)" << std::endl;
+  std::cout << "     -g: Number of output time samples to process per gulp (default = 4096)" << std::endl;
+  std::cout << "     -s: Number of standard deviations spanned by half of the output range when rescaling (default depends on -b)" << std::endl;
+  std::cout << "     -n: Do not rescale each channel; only scale the averaged data by the ratio of the input and output ranges" << std::endl << std::endl;
+  std::cout << "When writing 1- to 16-bit data, each output channel is rescaled using its mean and standard deviation in the first gulp," << std::endl;
+  std::cout << "so that the output is centered in the available range. 32-bit output is always the plain average of the input samples." << std::endl << std::endl;
+}
+
+// Overwrite the value of a fixed-size header parameter in a copy of a filterbank header
+// Returns 1 if the parameter was found, 0 otherwise
+int setHeaderParameter(char *header, int headerLength, const char *parameter, const void *value, size_t valueSize) {
+
+  int parameterLength = strlen(parameter);
+
+  // Header strings are stored as an int containing the string length, followed by the string itself and then the value
+  for (int position = sizeof(int); position + parameterLength + (int) valueSize <= headerLength; position++) {
+    if (*((int*) (header + position - sizeof(int))) == parameterLength && memcmp(header + position, parameter, parameterLength) == 0) {
+      memcpy(header + position + parameterLength, value, valueSize);
+      return 1;
+    }
+  }
+
+  return 0;
+
+}
+
+// Add one row (all channels of one time sample) of packed input data to an accumulator
+// These loops are kept free of branches so the compiler can vectorize them at -O3
+void accumulateRow(const unsigned char *row, int numBits, int numChans, uint32_t *integerSum, float *floatSum) {
+
+  int channel, byte;
+
+  switch (numBits) {
+
+    // 1-bit data; the first value is in the lowest bit
+    case 1:
+      for (byte = 0; byte < numChans/8; byte++) {
+        for (int bit = 0; bit < 8; bit++) {
+          integerSum[8 * byte + bit] += (row[byte] >> bit) & 1;
+        }
+      }
+      break;
+
+    // 2-bit data
+    case 2:
+      for (byte = 0; byte < numChans/4; byte++) {
+        integerSum[4 * byte] += row[byte] & 3;
+        integerSum[4 * byte + 1] += (row[byte] >> 2) & 3;
+        integerSum[4 * byte + 2] += (row[byte] >> 4) & 3;
+        integerSum[4 * byte + 3] += (row[byte] >> 6) & 3;
+      }
+      break;
+
+    // 4-bit data
+    case 4:
+      for (byte = 0; byte < numChans/2; byte++) {
+        integerSum[2 * byte] += row[byte] & 15;
+        integerSum[2 * byte + 1] += row[byte] >> 4;
+      }
+      break;
+
+    // 8-bit data
+    case 8:
+      for (channel = 0; channel < numChans; channel++) {
+        integerSum[channel] += row[channel];
+      }
+      break;
+
+    // 16-bit data
+    case 16:
+    {
+      const uint16_t *sixteenBitRow = (const uint16_t*) row;
+      for (channel = 0; channel < numChans; channel++) {
+        integerSum[channel] += sixteenBitRow[channel];
+      }
+      break;
+    }
+
+    // 32-bit data
+    case 32:
+    {
+      const float *floatRow = (const float*) row;
+      for (channel = 0; channel < numChans; channel++) {
+        floatSum[channel] += floatRow[channel];
+      }
+      break;
+    }
+
+  }
+
+}
+
+// Pack one row of output values into bytes, placing the first value in the lowest bits as SIGPROC expects
+void packRow(const float *values, int numBits, int numChans, unsigned char *row) {
+
+  int channel, valuesPerByte;
+
+  switch (numBits) {
+
+    case 1:
+    case 2:
+    case 4:
+      valuesPerByte = 8/numBits;
+      memset(row, 0, numChans/valuesPerByte);
+      for (channel = 0; channel < numChans; channel++) {
+        row[channel/valuesPerByte] |= ((unsigned char) values[channel]) << (numBits * (channel%valuesPerByte));
+      }
+      break;
+
+    case 8:
+      for (channel = 0; channel < numChans; channel++) {
+        row[channel] = (unsigned char) values[channel];
+      }
+      break;
+
+    case 16:
+      for (channel = 0; channel < numChans; channel++) {
+        ((uint16_t*) row)[channel] = (uint16_t) values[channel];
+      }
+      break;
+
+    case 32:
+      memcpy(row, values, sizeof(float) * numChans);
+      break;
+
+  }
+
+}
+
+/* -- filDecimate ---------------------------------------------------------------------------------------------
+** Averages a filterbank file in time and/or frequency and requantizes it to a new number of bits,           |
+** writing a new filterbank file with an updated header (tsamp, fch1, foff, nchans, nbits, nsamples).        |
+**                                                                                                           |
+** The file is streamed in gulps, so it never has to fit in memory. Works with 1-, 2-, 4-, 8-, 16-, and       |
+** 32-bit input and output. Integer data are accumulated as integers and only converted once per output value. |
+----------------------------------------------------------------------------------------------------------- */
+int main(int argc, char *argv[]) {
+
+  char string[80], sourceName[80], *header;
+  int nchar = sizeof(int), numChans = 0, numBits = 0, numIFs = 0, arg, rescale = 1;
+  int telescopeID, dataType, machineID, numBeams, beamNumber, samplesToAdd = 1, channelsToAdd = 1, outputBits = 0;
+  int numOutputChans, outputSamplesPerGulp = 4096, numValuesInSum, channel, bin;
+  double obsStart, sampTime, fCh1, fOff, RA, Dec, azimuthStart, zenithAngleStart, nSigma = -1.0;
+  double outputSampTime, outputFCh1, outputFOff;
+  long long numSamps = 0, numSamples, numOutputSamples, outputSample, sample, gulpSamples;
+  float outputLevels, outputMid, inputLevels;
+  std::ifstream file;
+  std::ofstream outputFile;
+
+  // If the user has not provided any arguments or has forgotten to use a flag, print usage and exit
+  if (argc < 3) {
+    usage();
+    exit(0);
+  }
+
+  // Read command line parameters
+  while ((arg = getopt(argc, argv, "b:c:f:g:hno:s:t:")) != -1) {
+    switch (arg) {
+
+      case 'b':
+        outputBits = atoi(optarg);
+        break;
+
+      case 'c':
+        channelsToAdd = atoi(optarg);
+        if (channelsToAdd < 1) {
+          std::cerr << "Cannot add less than one channel together! Defaulting to 1!" << std::endl;
+          channelsToAdd = 1;
+        }
+        break;
+
+      case 'f':
+        file.open(optarg, std::ifstream::binary | std::ifstream::ate);
+        if (!file.is_open()) {
+          std::cerr << "Error opening file " << optarg << std::endl;
+          usage();
+          exit(0);
+        }
+        break;
+
+      case 'g':
+        outputSamplesPerGulp = atoi(optarg);
+        if (outputSamplesPerGulp < 1) {
+          std::cerr << "Gulp must contain at least one output sample! Defaulting to 4096!" << std::endl;
+          outputSamplesPerGulp = 4096;
+        }
+        break;
+
+      case 'n':
+        rescale = 0;
+        break;
+
+      case 'o':
+        outputFile.open(optarg, std::ofstream::binary);
+        if (!outputFile.is_open()) {
+          std::cerr << "Could not open file " << optarg << " to write!" << std::endl;
+          exit(0);
+        }
+        break;
+
+      case 's':
+        nSigma = atof(optarg);
+        if (nSigma <= 0) {
+          std::cerr << "Number of standard deviations must be positive! Using the default!" << std::endl;
+          nSigma = -1.0;
+        }
+        break;
+
+      case 't':
+        samplesToAdd = atoi(optarg);
+        if (samplesToAdd < 1) {
+          std::cerr << "Cannot add less than one time sample together! Defaulting to 1!" << std::endl;
+          samplesToAdd = 1;
+        }
+        break;
+
+      case 'h':
+        usage();
+        exit(0);
+
+      default:
+        return 0;
+        break;
+
+    }
+  }
+
+  // Check if the input file has failed to open
+  if (!file.is_open()) {
+    std::cerr << "You must input a .fil file with the -f flag!" << std::endl;
+    usage();
+    exit(0);
+  }
+
+  // Check if the output file has failed to open
+  if (!outputFile.is_open()) {
+    std::cerr << "You must input an output file with the -o flag!" << std::endl;
+    usage();
+    exit(0);
+  }
+
+  // Since we opened the file at the end, report the size of the file. Once we have the header size we can calculate the length of the data.
+  const size_t fileSize = file.tellg();
+
+  // Seek back to the beginning of the file
+  file.seekg(0, file.beg);
+
+  // Read header parameters until "HEADER_END" is encountered
+  while (true) {
+
+    // Read string size
+    strcpy(string, "ERROR");
+    file.read((char*) &nchar, sizeof(int));
+    if (!file) {
+      std::cerr << "Error reading header string size!" << std::endl;
+      exit(0);
+    }
+
+    // Skip wrong strings
+    if (!(nchar > 1 && nchar < 80)) {
+      continue;
+    }
+
+    // Read string
+    file.read((char*) string, nchar);
+    if (!file) {
+      std::cerr << "Could not read header string!" << std::endl;
+      exit(0);
+    }
+    string[nchar] = '\0';
+
+    // Exit at end of header
+    if (strcmp(string, "HEADER_END") == 0) {
+      break;
+    }
+
+    // Read parameters
+    if (strcmp(string, "HEADER_START") == 0) {
+      continue;
+    } else if (strcmp(string, "tsamp") == 0) {
+      file.read((char*) &sampTime, sizeof(double));
+      if (!file) {
+        std::cerr << "Did not read header parameter 'tsamp' properly!" << std::endl;
+        exit(0);
+      }
+    } else if (strcmp(string, "tstart") == 0) {
+      file.read((char*) &obsStart, sizeof(double));
+      if (!file) {
+        std::cerr << "Did not read header parameter 'tstart' properly!" << std::endl;
+        exit(0);
+      }
+    } else if (strcmp(string, "fch1") == 0) {
+      file.read((char*) &fCh1, sizeof(double));
+      if (!file) {
+        std::cerr << "Did not read header parameter 'fch1' properly!" << std::endl;
+        exit(0);
+      }
+    } else if (strcmp(string, "foff") == 0) {
+      file.read((char*) &fOff, sizeof(double));
+      if (!file) {
+        std::cerr << "Did not read header parameter 'foff' properly!" << std::endl;
+        exit(0);
+      }
+    } else if (strcmp(string, "nchans") == 0) {
+      file.read((char*) &numChans, sizeof(int));
+      if (!file) {
+        std::cerr << "Did not read header parameter 'nchans' properly!" << std::endl;
+        exit(0);
+      }
+    } else if (strcmp(string, "nifs") == 0) {
+      file.read((char*) &numIFs, sizeof(int));
+      if (!file) {
+        std::cerr << "Did not read header parameter 'nifs' properly!" << std::endl;
+        exit(0);
+      }
+    } else if (strcmp(string, "nbits") == 0) {
+      file.read((char*) &numBits, sizeof(int));
+      if (!file) {
+        std::cerr << "Did not read header parameter 'nbits' properly!" << std::endl;
+        exit(0);
+      }
+    } else if (strcmp(string, "nsamples") == 0) {
+      file.read((char*) &numSamps, sizeof(int));
+      if (!file) {
+        std::cerr << "Did not read header parameter 'nsamples' properly!" << std::endl;
+        exit(0);
+      }
+    } else if (strcmp(string, "machine_id") == 0) {
+      file.read((char*) &machineID, sizeof(int));
+      if (!file) {
+        std::cerr << "Did not read header parameter 'machine_id' properly!" << std::endl;
+        exit(0);
+      }
+    } else if (strcmp(string, "telescope_id") == 0) {
+      file.read((char*) &telescopeID, sizeof(int));
+      if (!file) {
+        std::cerr << "Did not read header parameter 'telescope_id' properly!" << std::endl;
+        exit(0);
+      }
+    } else if (strcmp(string, "data_type") == 0) {
+      file.read((char*) &dataType, sizeof(int));
+      if (!file) {
+        std::cerr << "Did not read header parameter 'data_type' properly!" << std::endl;
+        exit(0);
+      }
+    } else if (strcmp(string, "source_name") == 0) {
+      file.read((char*) &nchar, sizeof(int));
+      file.read((char*) sourceName, nchar);
+      sourceName[nchar] = '\0';
+      if (!file) {
+        std::cerr << "Did not read header parameter 'source_name' properly!" << std::endl;
+        exit(0);
+      }
+    } else if (strcmp(string, "nbeams") == 0) {
+      file.read((char*) &numBeams, sizeof(int));
+      if (!file) {
+        std::cerr << "Did not read header parameter 'nbeams' properly!" << std::endl;
+        exit(0);
+      }
+    } else if (strcmp(string, "ibeam") == 0) {
+      file.read((char*) &beamNumber, sizeof(int));
+      if (!file) {
+        std::cerr << "Did not read header parameter 'ibeam' properly!" << std::endl;
+        exit(0);
+      }
+    } else if (strcmp(string, "src_raj") == 0) {
+      file.read((char*) &RA, sizeof(double));
+      if (!file) {
+        std::cerr << "Did not read header parameter 'src_raj' properly!" << std::endl;
+        exit(0);
+      }
+    } else if (strcmp(string, "src_dej") == 0) {
+      file.read((char*) &Dec, sizeof(double));
+      if (!file) {
+        std::cerr << "Did not read header parameter 'src_dej' properly!" << std::endl;
+        exit(0);
+      }
+    } else if (strcmp(string, "az_start") == 0) {
+      file.read((char*) &azimuthStart, sizeof(double));
+      if (!file) {
+        std::cerr << "Did not read header parameter 'az_start' properly!" << std::endl;
+        exit(0);
+      }
+    } else if (strcmp(string, "za_start") == 0) {
+      file.read((char*) &zenithAngleStart, sizeof(double));
+      if (!file) {
+        std::cerr << "Did not read header parameter 'za_start' properly!" << std::endl;
+        exit(0);
+      }
+    } else {
+      std::cerr << "Unknown header parameter " << string << std::endl;
+    }
+
+  }
+
+  std::cerr << "Done reading header!" << std::endl;
+
+  // Set the header length to the current position in the file, since we just encountered "HEADER_END"
+  const int headerLength = file.tellg();
+
+  // If no output bit width was requested, keep the input bit width
+  if (outputBits == 0) {
+    outputBits = numBits;
+  }
+
+  // Check the input and output bit widths
+  if (numBits != 1 && numBits != 2 && numBits != 4 && numBits != 8 && numBits != 16 && numBits != 32) {
+    std::cerr << "Cannot read " << numBits << " bit data!" << std::endl << "Data must be 1-, 2-, 4-, 8-, 16-, or 32-bit!" << std::endl;
+    exit(0);
+  }
+  if (outputBits != 1 && outputBits != 2 && outputBits != 4 && outputBits != 8 && outputBits != 16 && outputBits != 32) {
+    std::cerr << "Cannot write " << outputBits << " bit data!" << std::endl << "Data must be 1-, 2-, 4-, 8-, 16-, or 32-bit!" << std::endl;
+    exit(0);
+  }
+
+  // Channels left over after adding 'channelsToAdd' channels together are dropped, as in plotFil
+  numOutputChans = numChans/channelsToAdd;
+  if (numOutputChans < 1) {
+    std::cerr << "Cannot add " << channelsToAdd << " channels together when there are only " << numChans << " channels!" << std::endl;
+    exit(0);
+  }
+  if (numChans%channelsToAdd != 0) {
+    std::cerr << "Number of channels is not a multiple of " << channelsToAdd << "; dropping the last " << numChans%channelsToAdd << " channels!" << std::endl;
+  }
+
+  // Every row of data must occupy a whole number of bytes
+  if (((long long) numChans * numBits)%8 != 0 || ((long long) numOutputChans * outputBits)%8 != 0) {
+    std::cerr << "Each time sample must fill a whole number of bytes!" << std::endl;
+    exit(0);
+  }
+
+  const size_t inputRowBytes = (size_t) numChans * numBits/8;
+  const size_t outputRowBytes = (size_t) numOutputChans * outputBits/8;
+
+  // Calculate how many samples are in the file and how many will be written
+  numSamples = (fileSize - headerLength)/inputRowBytes;
+  numOutputSamples = numSamples/samplesToAdd;
+
+  // Choose the default rescaling range for the output bit width, i.e. how many standard deviations half of the output range covers
+  if (nSigma < 0) {
+    if (outputBits <= 2) {
+      nSigma = 2.0;
+    } else if (outputBits == 4) {
+      nSigma = 3.0;
+    } else {
+      nSigma = 6.0;
+    }
+  }
+
+  outputLevels = pow(2.0, outputBits < 32 ? outputBits : 0);
+  outputMid = 0.5 * (outputLevels - 1.0);
+  inputLevels = pow(2.0, numBits < 32 ? numBits : 0);
+
+  // Work out the new header values
+  // The first output channel is centered on the middle of the first 'channelsToAdd' input channels
+  outputSampTime = sampTime * samplesToAdd;
+  outputFOff = fOff * channelsToAdd;
+  outputFCh1 = fCh1 + 0.5 * (channelsToAdd - 1) * fOff;
+
+  // Copy the header and update the parameters that change
+  header = (char*) malloc(headerLength);
+  file.seekg(0, file.beg);
+  file.read(header, headerLength);
+  if (!file) {
+    std::cerr << "Could not read header!" << std::endl;
+    exit(0);
+  }
+  if (!setHeaderParameter(header, headerLength, "tsamp", &outputSampTime, sizeof(double)) || !setHeaderParameter(header, headerLength, "fch1", &outputFCh1, sizeof(double)) || !setHeaderParameter(header, headerLength, "foff", &outputFOff, sizeof(double)) || !setHeaderParameter(header, headerLength, "nchans", &numOutputChans, sizeof(int)) || !setHeaderParameter(header, headerLength, "nbits", &outputBits, sizeof(int))) {
+    std::cerr << "Header is missing one of 'tsamp', 'fch1', 'foff', 'nchans', or 'nbits'!" << std::endl;
+    exit(0);
+  }
+  int numOutputSamps = numOutputSamples;
+  setHeaderParameter(header, headerLength, "nsamples", &numOutputSamps, sizeof(int));
+  outputFile.write(header, headerLength);
+  free(header);
+
+  std::cout << "Decimating " << numSamples << " samples x " << numChans << " channels (" << numBits << "-bit) to " << numOutputSamples << " samples x " << numOutputChans << " channels (" << outputBits << "-bit)" << std::endl;
+
+  // Buffers for one gulp of input and output, plus the per-row accumulators
+  std::vector<unsigned char> inputGulp((size_t) outputSamplesPerGulp * samplesToAdd * inputRowBytes);
+  std::vector<unsigned char> outputGulp((size_t) outputSamplesPerGulp * outputRowBytes);
+  std::vector<uint32_t> integerSum(numChans);
+  std::vector<float> floatSum(numChans), averaged((size_t) outputSamplesPerGulp * numOutputChans);
+  std::vector<float> channelMean(numOutputChans, 0), channelScale(numOutputChans, 1), outputRow(numOutputChans);
+
+  numValuesInSum = samplesToAdd * channelsToAdd;
+
+  for (outputSample = 0; outputSample < numOutputSamples; outputSample += gulpSamples) {
+
+    gulpSamples = std::min((long long) outputSamplesPerGulp, numOutputSamples - outputSample);
+
+    // Read the input samples for this gulp in one go
+    file.read((char*) &inputGulp[0], gulpSamples * samplesToAdd * inputRowBytes);
+    if (!file) {
+      std::cerr << "Could not read data properly!" << std::endl;
+      exit(0);
+    }
+
+    // Add 'samplesToAdd' rows and then 'channelsToAdd' channels together for each output sample
+    for (sample = 0; sample < gulpSamples; sample++) {
+
+      std::fill(integerSum.begin(), integerSum.end(), 0);
+      std::fill(floatSum.begin(), floatSum.end(), 0.0);
+      for (bin = 0; bin < samplesToAdd; bin++) {
+        accumulateRow(&inputGulp[(sample * samplesToAdd + bin) * inputRowBytes], numBits, numChans, &integerSum[0], &floatSum[0]);
+      }
+
+      float *averagedRow = &averaged[sample * numOutputChans];
+      if (numBits == 32) {
+        for (channel = 0; channel < numOutputChans; channel++) {
+          float channelSum = 0.0;
+          for (bin = 0; bin < channelsToAdd; bin++) {
+            channelSum += floatSum[channel * channelsToAdd + bin];
+          }
+          averagedRow[channel] = channelSum/(float) numValuesInSum;
+        }
+      } else {
+        for (channel = 0; channel < numOutputChans; channel++) {
+          uint32_t channelSum = 0;
+          for (bin = 0; bin < channelsToAdd; bin++) {
+            channelSum += integerSum[channel * channelsToAdd + bin];
+          }
+          averagedRow[channel] = (float) channelSum/(float) numValuesInSum;
+        }
+      }
+
+    }
+
+    // Use the first gulp to find the mean and standard deviation of each output channel, which fixes the rescaling for the whole file
+    if (outputSample == 0 && rescale && outputBits < 32) {
+      for (channel = 0; channel < numOutputChans; channel++) {
+        double sum = 0.0, sumOfSquares = 0.0, standardDeviation;
+        for (sample = 0; sample < gulpSamples; sample++) {
+          sum += averaged[sample * numOutputChans + channel];
+          sumOfSquares += averaged[sample * numOutputChans + channel] * averaged[sample * numOutputChans + channel];
+        }
+        channelMean[channel] = sum/gulpSamples;
+        standardDeviation = sqrt(std::max(0.0, sumOfSquares/gulpSamples - channelMean[channel] * channelMean[channel]));
+        // A constant (e.g. masked) channel is simply placed in the middle of the output range
+        channelScale[channel] = standardDeviation > 0 ? 0.5 * outputLevels/(nSigma * standardDeviation) : 0.0;
+      }
+    }
+
+    // Requantize each averaged sample to the output bit width and pack it
+    for (sample = 0; sample < gulpSamples; sample++) {
+
+      const float *averagedRow = &averaged[sample * numOutputChans];
+
+      if (outputBits == 32) {
+        std::copy(averagedRow, averagedRow + numOutputChans, outputRow.begin());
+      } else if (rescale) {
+        for (channel = 0; channel < numOutputChans; channel++) {
+          outputRow[channel] = std::min(std::max(floorf(outputMid + (averagedRow[channel] - channelMean[channel]) * channelScale[channel] + 0.5f), 0.0f), outputLevels - 1.0f);
+        }
+      } else {
+        // Without rescaling, integer data are mapped from the input range onto the output range and floats are simply clipped
+        float rangeScale = numBits < 32 ? (outputLevels - 1.0f)/(inputLevels - 1.0f) : 1.0f;
+        for (channel = 0; channel < numOutputChans; channel++) {
+          outputRow[channel] = std::min(std::max(floorf(averagedRow[channel] * rangeScale + 0.5f), 0.0f), outputLevels - 1.0f);
+        }
+      }
+
+      packRow(&outputRow[0], outputBits, numOutputChans, &outputGulp[sample * outputRowBytes]);
+
+    }
+
+    outputFile.write((char*) &outputGulp[0], gulpSamples * outputRowBytes);
+    if (!outputFile) {
+      std::cerr << "Could not write data properly!" << std::endl;
+      exit(0);
+    }
+
+  }
+
+  file.close();
+  outputFile.close();
+
+  return 0;
+
+}
@@ -4,10 +4,29 @@
 #include <cmath>
 #include "cpgplot.h"
 #include <getopt.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <fstream>
 #include <iostream>
 #include <vector>
 #include <algorithm>
+#include "eventFile.h"
+
+// Events are drawn with larger markers for higher S/N; an event goes in the first bucket whose upper S/N limit it does not exceed,
+// except that the first bucket only holds events below its limit, so events exactly at it get no marker (as plotEvents always has)
+const int numMarkerBuckets = 5;
+const float markerBucketSNRLimits[numMarkerBuckets] = {10, 20, 50, 100, INFINITY};
+const int markerBucketSymbols[numMarkerBuckets] = {20, 22, 24, 26, 28};
+
+// Draw all the points in 'x' and 'y' with one PGPLOT call (or a few, if there are more points than an int can count)
+void plotPoints(const std::vector<float> &x, const std::vector<float> &y, int symbol) {
+  const size_t maxPointsPerCall = 1 << 30;
+  for (size_t start = 0; start < x.size(); start += maxPointsPerCall) {
+    cpgpt((int) std::min(maxPointsPerCall, x.size() - start), &x[start], &y[start], symbol);
+  }
+}
 
 // External function to print help if needed
 void usage() {
@@ -21,7 +40,10 @@ void usage() {
   std::cout << "     -T: Maximum time to plot" << std::endl;
   std::cout << "     -w: Minimum width to plot" << std::endl;
   std::cout << "     -W: Maximum width to plot" << std::endl;
-  std::cout << "     -g: Output plot type (default = /xs)" << std::endl << std::endl;
+  std::cout << "     -g: Output plot type (default = /xs)" << std::endl;
+  std::cout << "     -L: Above this many events, plot a time-DM density map instead of every event (default = 100000, 0 = never)" << std::endl;
+  std::cout << "     -N: Number of highest S/N events drawn over the density map and in the side panels (default = 1000)" << std::endl;
+  std::cout << "     -M: Shade the density map by the maximum S/N in each bin, rather than the number of events" << std::endl << std::endl;
 }
 
 /* -- plotEvents -----------------------------------------------------------------------------------------------------------------
@@ -32,24 +54,26 @@ void usage() {
 ------------------------------------------------------------------------------------------------------------------------------- */
 int main(int argc, char *argv[]) {
 
-  int arg, dataPlotted = 0;
-  float timeMin = 0.0/0.0, timeMax = 0.0/0.0, dmMin = 0.0/0.0, dmMax = 0.0/0.0, snrMin = 0.0/0.0, snrMax = 0.0/0.0, widthMin = 0.0/0.0, widthMax = 0.0/0.0, logWidth;
+  int arg, fileDescriptor = -1, useMaxSNR = 0;
+  char *eventFileName = NULL;
+  size_t densityMapLimit = 100000, numberOfTopEvents = 1000;
+  float timeMin = 0.0/0.0, timeMax = 0.0/0.0, dmMin = 0.0/0.0, dmMax = 0.0/0.0, snrMin = 0.0/0.0, snrMax = 0.0/0.0, widthMin = 0.0/0.0, widthMax = 0.0/0.0;
   float timeMinFile = 0.0/0.0, timeMaxFile = 0.0/0.0, dmMinFile = 0.0/0.0, dmMaxFile = 0.0/0.0, snrMinFile = 0.0/0.0, snrMaxFile = 0.0/0.0, widthMinFile = 0.0/0.0, widthMaxFile = 0.0/0.0;
-  float line[4];
   char plotType[128] = "/xs";
-  std::ifstream file;
+  struct stat fileStatus;
 
   if (argc < 3) {
     usage();
     exit(0);
   }
 
-  while ((arg = getopt(argc, argv, "d:D:f:g:hs:S:t:T:w:W:")) != -1) {
+  while ((arg = getopt(argc, argv, "d:D:f:g:hL:MN:s:S:t:T:w:W:")) != -1) {
     switch (arg) {
 
       case 'f':
-        file.open(argv[optind - 1], std::ifstream::binary | std::ifstream::ate);
-        if (!file.is_open()) {
+        eventFileName = argv[optind - 1];
+        fileDescriptor = open(eventFileName, O_RDONLY);
+        if (fileDescriptor < 0) {
           std::cout << "Error opening file " << argv[optind - 1] << std::endl;
           usage();
           exit(0);
@@ -92,6 +116,18 @@ int main(int argc, char *argv[]) {
         widthMax = atof(optarg);
         break;
 
+      case 'L':
+        densityMapLimit = atol(optarg);
+        break;
+
+      case 'M':
+        useMaxSNR = 1;
+        break;
+
+      case 'N':
+        numberOfTopEvents = atol(optarg);
+        break;
+
       case 'h':
         usage();
         exit(0);
@@ -103,47 +139,107 @@ int main(int argc, char *argv[]) {
     }
   }
 
-  if (!file.is_open()) {
+  if (fileDescriptor < 0) {
     std::cout << "You must input a .dat file with the -f flag!" << std::endl;
     usage();
     exit(0);
   }
 
-  // The file was opened at the end, so determine how many detections there are
-  const size_t numberOfDetections = file.tellg()/sizeof(float)/4.0;
-  // Seek back to the beginning of the file
-  file.seekg(0, std::ifstream::beg);
+  // Determine how many detections there are from the size of the file
+  fstat(fileDescriptor, &fileStatus);
+  const size_t numberOfDetections = fileStatus.st_size/sizeof(event);
 
   // If there are no detections in the file, close it and exit; this shouldn't happen, beacuse if there are no detections, a file should not be written
   if (numberOfDetections < 1) {
-    file.close();
+    close(fileDescriptor);
     std::cout << "No detections in file (how did this happen?!), exiting..." << std::endl;
     return 0;
   }
 
-  // Create vectors to hold separate parameters for each event
-  std::vector<float> DMs(0, numberOfDetections), times(0, numberOfDetections), SNRs(0, numberOfDetections), widths(0, numberOfDetections);
-
-  // Read data from file into vectors
-  while (file.read(reinterpret_cast<char*>(&line), sizeof(float) * 4)) {
-    DMs.push_back(line[0]);
-    times.push_back(line[1]);
-    SNRs.push_back(line[2]);
-    widths.push_back(line[3]);
+  // Map the file into memory and use it directly as an array of events, rather than copying it
+  void *mappedFile = mmap(NULL, numberOfDetections * sizeof(event), PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+  if (mappedFile == MAP_FAILED) {
+    std::cout << "Could not map the event file into memory!" << std::endl;
+    close(fileDescriptor);
+    return 0;
+  }
+  const event *events = (const event*) mappedFile;
+
+  // Limits used to select events to plot; limits the user has not set select everything, just as the extrema of the file would
+  // The S/N limits are rounded outwards to integers, as they are for plotting below
+  const float snrLow = snrMin == snrMin ? floor(snrMin) : -INFINITY, snrHigh = snrMax == snrMax ? ceil(snrMax) : INFINITY;
+  const float timeLow = timeMin == timeMin ? timeMin : -INFINITY, timeHigh = timeMax == timeMax ? timeMax : INFINITY;
+  const float dmLow = dmMin == dmMin ? dmMin : -INFINITY, dmHigh = dmMax == dmMax ? dmMax : INFINITY;
+
+  // If the file has an up-to-date index (written by eventIndex), the extrema of the file come from the index, and only the blocks
+  // of events that overlap the requested ranges are read; otherwise the whole file is read
+  EventIndex index;
+  std::vector<std::pair<size_t, size_t>> eventRanges; // First event and number of events in each range to read
+  snrMinFile = timeMinFile = dmMinFile = widthMinFile = INFINITY;
+  snrMaxFile = timeMaxFile = dmMaxFile = widthMaxFile = -INFINITY;
+  if (loadEventIndex(index, eventFileName, numberOfDetections)) {
+    size_t blocksToRead = 0;
+    for (const eventBlock &block : index.blocks) {
+      snrMinFile = std::min(snrMinFile, block.snrMin);
+      snrMaxFile = std::max(snrMaxFile, block.snrMax);
+      timeMinFile = std::min(timeMinFile, block.timeMin);
+      timeMaxFile = std::max(timeMaxFile, block.timeMax);
+      dmMinFile = std::min(dmMinFile, block.dmMin);
+      dmMaxFile = std::max(dmMaxFile, block.dmMax);
+      widthMinFile = std::min(widthMinFile, block.widthMin);
+      widthMaxFile = std::max(widthMaxFile, block.widthMax);
+      if (block.snrMax < snrLow || block.snrMin > snrHigh || block.timeMax < timeLow || block.timeMin > timeHigh || block.dmMax < dmLow || block.dmMin > dmHigh) {
+        continue;
+      }
+      // Merge neighbouring blocks into one range
+      if (eventRanges.size() > 0 && eventRanges.back().first + eventRanges.back().second == block.firstEvent) {
+        eventRanges.back().second += block.numEvents;
+      } else {
+        eventRanges.push_back(std::make_pair((size_t) block.firstEvent, (size_t) block.numEvents));
+      }
+      blocksToRead++;
+    }
+    madvise(mappedFile, numberOfDetections * sizeof(event), MADV_RANDOM);
+    std::cout << "Reading " << blocksToRead << " of " << index.blocks.size() << " blocks using index " << eventIndexFileName(eventFileName) << std::endl;
+  } else {
+    eventRanges.push_back(std::make_pair((size_t) 0, numberOfDetections));
+    madvise(mappedFile, numberOfDetections * sizeof(event), MADV_SEQUENTIAL);
   }
 
-  // Close the file now that we've read its contents
-  file.close();
-
-  // Find extrema of time, DM, SNR, and width from file
-  snrMinFile = *std::min_element(SNRs.begin(), SNRs.end());
-  snrMaxFile = *std::max_element(SNRs.begin(), SNRs.end());
-  timeMinFile = *std::min_element(times.begin(), times.end());
-  timeMaxFile = *std::max_element(times.begin(), times.end());
-  dmMinFile = *std::min_element(DMs.begin(), DMs.end());
-  dmMaxFile = *std::max_element(DMs.begin(), DMs.end());
-  widthMinFile = *std::min_element(widths.begin(), widths.end());
-  widthMaxFile = *std::max_element(widths.begin(), widths.end());
+  // Find the extrema of time, DM, S/N, and width in the file, and select the events to plot, in a single pass
+  // With an index, the extrema of the events read can't extend those of the whole file, which are already known
+  // Events are handled in chunks so the extrema and selection tests run as a simple loop the compiler can vectorize
+  // The time, DM, S/N, and log2 width of the selected events are then copied into contiguous arrays, from which they can be drawn with one call per panel
+  const size_t chunkSize = 4096;
+  unsigned char isSelected[chunkSize];
+  size_t numberSelected = 0;
+  std::vector<float> selectedTimes, selectedDMs, selectedSNRs, selectedLogWidths;
+  for (const std::pair<size_t, size_t> &range : eventRanges) {
+    for (size_t chunkStart = range.first; chunkStart < range.first + range.second; chunkStart += chunkSize) {
+      const size_t chunkLength = std::min(chunkSize, range.first + range.second - chunkStart);
+      const event *chunk = events + chunkStart;
+      for (size_t i = 0; i < chunkLength; i++) {
+        snrMinFile = std::min(snrMinFile, chunk[i].snr);
+        snrMaxFile = std::max(snrMaxFile, chunk[i].snr);
+        timeMinFile = std::min(timeMinFile, chunk[i].time);
+        timeMaxFile = std::max(timeMaxFile, chunk[i].time);
+        dmMinFile = std::min(dmMinFile, chunk[i].dm);
+        dmMaxFile = std::max(dmMaxFile, chunk[i].dm);
+        widthMinFile = std::min(widthMinFile, chunk[i].width);
+        widthMaxFile = std::max(widthMaxFile, chunk[i].width);
+        isSelected[i] = (chunk[i].snr >= snrLow) & (chunk[i].snr <= snrHigh) & (chunk[i].time >= timeLow) & (chunk[i].time <= timeHigh) & (chunk[i].dm >= dmLow) & (chunk[i].dm <= dmHigh);
+      }
+      for (size_t i = 0; i < chunkLength; i++) {
+        if (isSelected[i]) {
+          selectedTimes.push_back(chunk[i].time);
+          selectedDMs.push_back(chunk[i].dm);
+          selectedSNRs.push_back(chunk[i].snr);
+          selectedLogWidths.push_back(log10(chunk[i].width)/log10(2.0));
+          numberSelected++;
+        }
+      }
+    }
+  }
 
   // Check for NaNs; a variable set to NaN will never equal itself
   // If a variable is NaN, it was not given as user input, and should be set given the data in the file
@@ -230,21 +326,57 @@ int main(int argc, char *argv[]) {
   std::cout << numberOfDetections << " events found:" << std::endl;
   std::cout << "Time: " << timeMin << " " << timeMax << ", DM: " << dmMin << " " << dmMax <<  ", SNR: " << snrMin << " " << snrMax << ", Width: " << widthMin << " " << widthMax << std::endl;
 
-  // Check if any event fals into the requested time and DM range above the minimum (requested) S/N and below the maximum (requested) S/N
-  for (std::vector<float>::iterator i = SNRs.begin(); i != SNRs.end(); ++i) {
-    if (*i >= snrMin && *i <= snrMax) { // Check if the S/N of this event is within the requested range
-      if (times[std::distance(SNRs.begin(), i)] >= timeMin && times[std::distance(SNRs.begin(), i)] <= timeMax && DMs[std::distance(SNRs.begin(), i)] >= dmMin && DMs[std::distance(SNRs.begin(), i)] <= dmMax) { // Check if this event is within the requested time and DM range
-        dataPlotted = 1; // Signifiy that we will plot at least one point
-      }
-    }
-  }
-
   // If no points will be plotted in the DM vs time plot, don't bother plotting anything, just exit here
-  if (dataPlotted == 0) {
+  if (numberSelected == 0) {
     std::cout << std::endl << std::endl << "No events detected within the time, DM, S/N, and width parameters provided!" << std::endl << std::endl;
     return 0;
   }
 
+  // With too many events to usefully draw one by one, the DM vs time panel shows a density map, and only the highest S/N events are drawn as points
+  const bool plotDensityMap = densityMapLimit > 0 && numberSelected > densityMapLimit;
+  std::vector<size_t> plotted;
+  if (plotDensityMap && numberOfTopEvents < numberSelected) {
+    // Find the highest S/N events without fully sorting them
+    plotted.resize(numberSelected);
+    for (size_t i = 0; i < numberSelected; i++) {
+      plotted[i] = i;
+    }
+    std::nth_element(plotted.begin(), plotted.begin() + numberOfTopEvents, plotted.end(), [&selectedSNRs](size_t a, size_t b) { return selectedSNRs[a] > selectedSNRs[b]; });
+    plotted.resize(numberOfTopEvents);
+    std::sort(plotted.begin(), plotted.end());
+    std::cout << "Plotting a density map of " << numberSelected << " events, and the " << numberOfTopEvents << " highest S/N events" << std::endl;
+  } else {
+    plotted.resize(numberSelected);
+    for (size_t i = 0; i < numberSelected; i++) {
+      plotted[i] = i;
+    }
+  }
+
+  // Sort the events to draw by marker size, so each size can be drawn with one call
+  std::vector<float> bucketTimes[numMarkerBuckets], bucketDMs[numMarkerBuckets], plottedTimes, plottedDMs, plottedSNRs, plottedLogWidths;
+  for (size_t i : plotted) {
+    int bucket = 0;
+    while (selectedSNRs[i] > markerBucketSNRLimits[bucket]) {
+      bucket++;
+    }
+    if (selectedSNRs[i] != markerBucketSNRLimits[0]) {
+      bucketTimes[bucket].push_back(selectedTimes[i]);
+      bucketDMs[bucket].push_back(selectedDMs[i]);
+    }
+    if (plotDensityMap) {
+      plottedTimes.push_back(selectedTimes[i]);
+      plottedDMs.push_back(selectedDMs[i]);
+      plottedSNRs.push_back(selectedSNRs[i]);
+      plottedLogWidths.push_back(selectedLogWidths[i]);
+    }
+  }
+  if (!plotDensityMap) {
+    plottedTimes.swap(selectedTimes);
+    plottedDMs.swap(selectedDMs);
+    plottedSNRs.swap(selectedSNRs);
+    plottedLogWidths.swap(selectedLogWidths);
+  }
+
   // Open the requested plot (default /xs)
   cpgopen(plotType);
 
@@ -257,24 +389,42 @@ int main(int argc, char *argv[]) {
   cpgbox("BCTSN", 0., 0, "BCTSN", 0., 0);
   cpglab("Time (s)", "DM (pc cm\\u-3\\d)", " ");
 
-  // Plot each event in the requested time and DM range above the minimum (requested) S/N and below the maximum (requested) S/N, using larger points for higher S/N events
-  for (std::vector<float>::iterator i = SNRs.begin(); i != SNRs.end(); ++i) {
-    if (*i >= snrMin && *i <= snrMax) { // Check if the S/N of this event is within the requested range
-      if (times[std::distance(SNRs.begin(), i)] >= timeMin && times[std::distance(SNRs.begin(), i)] <= timeMax && DMs[std::distance(SNRs.begin(), i)] >= dmMin && DMs[std::distance(SNRs.begin(), i)] <= dmMax) { // Check if this event is within the requested time and DM range
-        if (*i < 10) {
-          cpgpt1(times[std::distance(SNRs.begin(), i)], DMs[std::distance(SNRs.begin(), i)], 20);
-        } else if (*i > 10 && *i <= 20) {
-          cpgpt1(times[std::distance(SNRs.begin(), i)], DMs[std::distance(SNRs.begin(), i)], 22);
-        } else if (*i > 20 && *i <= 50) {
-          cpgpt1(times[std::distance(SNRs.begin(), i)], DMs[std::distance(SNRs.begin(), i)], 24);
-        } else if (*i > 50 && *i <= 100) {
-          cpgpt1(times[std::distance(SNRs.begin(), i)], DMs[std::distance(SNRs.begin(), i)], 26);
-        } else if (*i > 100) {
-          cpgpt1(times[std::distance(SNRs.begin(), i)], DMs[std::distance(SNRs.begin(), i)], 28);
-        }
+  if (plotDensityMap) {
+    // Bin the events in time and DM in one pass, counting them or keeping the highest S/N in each bin
+    // Counts are shown on a log scale, so a few events are still visible next to a dense patch of RFI
+    const int numTimeBins = 800, numDMBins = 400;
+    const float timeBinWidth = (timeMax - timeMin)/numTimeBins, dmBinWidth = (dmMax - dmMin)/numDMBins;
+    std::vector<float> densityMap((size_t) numTimeBins * numDMBins, useMaxSNR ? snrMin : 0.0);
+    for (size_t i = 0; i < selectedTimes.size(); i++) {
+      int timeBin = timeBinWidth > 0 ? (int) ((selectedTimes[i] - timeMin)/timeBinWidth) : 0;
+      int dmBin = dmBinWidth > 0 ? (int) ((selectedDMs[i] - dmMin)/dmBinWidth) : 0;
+      timeBin = std::max(0, std::min(numTimeBins - 1, timeBin));
+      dmBin = std::max(0, std::min(numDMBins - 1, dmBin));
+      float &bin = densityMap[(size_t) dmBin * numTimeBins + timeBin];
+      bin = useMaxSNR ? std::max(bin, selectedSNRs[i]) : bin + 1;
+    }
+    float mapMin = useMaxSNR ? snrMin : 0.0, mapMax = mapMin;
+    for (float &bin : densityMap) {
+      if (!useMaxSNR) {
+        bin = log10(1 + bin);
       }
+      mapMax = std::max(mapMax, bin);
     }
+
+    // Pixel (i, j) of the map (counting from 1) is centred on time timeMin + (i - 0.5) * timeBinWidth and DM dmMin + (j - 0.5) * dmBinWidth
+    const float transform[6] = {timeMin - 0.5f * timeBinWidth, timeBinWidth, 0, dmMin - 0.5f * dmBinWidth, 0, dmBinWidth};
+    cpgimag(&densityMap[0], numTimeBins, numDMBins, 1, numTimeBins, 1, numDMBins, mapMin, mapMax, transform);
+    cpgbox("BCTSN", 0., 0, "BCTSN", 0., 0);
+
+    // Draw the highest S/N events in a colour that stands out from the map
+    cpgsci(2);
+  }
+
+  // Plot each event in the requested time and DM range above the minimum (requested) S/N and below the maximum (requested) S/N, using larger points for higher S/N events
+  for (int bucket = 0; bucket < numMarkerBuckets; bucket++) {
+    plotPoints(bucketTimes[bucket], bucketDMs[bucket], markerBucketSymbols[bucket]);
   }
+  cpgsci(1);
 
   // Create a S/N vs DM plot
   cpgsvp(0.81, 0.9, 0.1, 0.8);
@@ -283,13 +433,7 @@ int main(int argc, char *argv[]) {
   cpglab("SNR", "", " ");
 
   // Plot each event in the requested time and DM range above the minimum (requested) S/N and below the maximum (requested) S/N
-  for (std::vector<float>::iterator i = SNRs.begin(); i != SNRs.end(); ++i) {
-    if (*i >= snrMin && *i <= snrMax) { // Check if the S/N of this event is within the requested range
-      if (times[std::distance(SNRs.begin(), i)] >= timeMin && times[std::distance(SNRs.begin(), i)] <= timeMax && DMs[std::distance(SNRs.begin(), i)] >= dmMin && DMs[std::distance(SNRs.begin(), i)] <= dmMax) { // Check if this event is within the requested time and DM range
-        cpgpt1(*i, DMs[std::distance(SNRs.begin(), i)], 1);
-      }
-    }
-  }
+  plotPoints(plottedSNRs, plottedDMs, 1);
 
   // Create a time vs width plot
   cpgsvp(0.1, 0.8, 0.81, 0.95);
@@ -298,18 +442,15 @@ int main(int argc, char *argv[]) {
   cpglab("", "Width (log2 samples)", " ");
 
   // Plot each event above the minimum (requested) S/N and below the maximum (requested) S/N
-  for (std::vector<float>::iterator i = SNRs.begin(); i != SNRs.end(); ++i) {
-    if (*i >= snrMin && *i <= snrMax) { // Check if the S/N of this event is within the requested range
-      if (times[std::distance(SNRs.begin(), i)] >= timeMin && times[std::distance(SNRs.begin(), i)] <= timeMax && DMs[std::distance(SNRs.begin(), i)] >= dmMin && DMs[std::distance(SNRs.begin(), i)] <= dmMax) { // Check if this event is within the requested time and DM range
-        logWidth = log10(widths[std::distance(SNRs.begin(), i)])/log10(2.0);
-        cpgpt1(times[std::distance(SNRs.begin(), i)], logWidth, 1);
-      }
-    }
-  }
+  plotPoints(plottedTimes, plottedLogWidths, 1);
 
   // Close plot file and release graphics device
   cpgend();
 
+  // Unmap and close the event file
+  munmap(mappedFile, numberOfDetections * sizeof(event));
+  close(fileDescriptor);
+
   return 0;
 
 }
@@ -8,6 +8,7 @@
 #include <iostream>
 #include <vector>
 #include <algorithm>
+#include "dedispersionPlan.h"
 
 #define LIM 256
 
@@ -40,7 +41,7 @@ int main(int argc, char *argv[]) {
   unsigned short sixteenBitInt;
   double obsStart, sampTime, fCh1, fOff;
   long long numSamples = 0, numSamps = 0, sample, channel, numTimePoints, numChannels, numDataPointsAdded, bin, inputIndex, outputIndex;
-  float dataMin, dataMax, frequency, dm = 0.0, dmDelay;
+  float dataMin, dataMax, dm = 0.0;
   float minPlotTime, maxPlotTime, freqMin, freqMax, t0 = -1.0, tl = -1.0, ts = -1.0, startTime, endTime;
   float tr[] = {-0.5, 1.0, 0.0, -0.5, 0.0, 1.0};
   float heat_l[] = {0.0, 0.2, 0.4, 0.6, 1.0}, heat_r[] = {0.0, 0.5, 1.0, 1.0, 1.0}, heat_g[] = {0.0, 0.0, 0.5, 1.0, 1.0}, heat_b[] = {0.0, 0.0, 0.0, 0.3, 1.0};
@@ -383,16 +384,10 @@ int main(int argc, char *argv[]) {
   // Close file
   file.close();
 
-  // Create a zero-filled vector of delays in time samples for each channel
-  std::vector<int> dmDelaySamps(numChans, 0);
-  // Compute dispersion shifts for each channel if the DM is not zero; otherwise the above zero-filled vector is already correct
-  if (dm > 0.0) {
-    for (channel = 0; channel < numChans; channel++) {
-      frequency = fCh1 + (float) channel * fOff;
-      dmDelay = 4.148808e3 * (pow(frequency, -2) - pow(fCh1, -2)) * dm;
-      dmDelaySamps[channel] = (int) floor(dmDelay/sampTime + 0.5);
-    }
-  }
+  // Get the delay in time samples for each channel from a dedispersion plan for this one DM (all zeros if the DM is zero)
+  DedispersionPlan plan;
+  computeDedispersionPlan(plan, fCh1, fOff, numChans, sampTime, std::vector<double>(1, dm));
+  const std::vector<int> &dmDelaySamps = plan.delaySamps;
 
   // Calculate the number of points in time that will be plotted. This number will differ from the number of time samples only if the -b option is used to bin the data in time.
   numTimePoints = (long long) ((float) numSamples/(float) samplesToAdd);
@@ -1,73 +1,501 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <cerrno>
+#include <cmath>
+#include <csignal>
+#include <ctime>
 #include <iostream>
-#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
 #include <unistd.h>
-#include <sys/types.h> 
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
 #include <netinet/in.h>
+#include <arpa/inet.h>
 #include <getopt.h>
 
 // External function to print help if needed
 void usage(void) {
-  std::cout << std::endl << "receiver -p <port> -b <blockSize> -f <file>" << std::endl << std::endl;
+  std::cout << std::endl << "receiver -p <port> (-p <port> ...) -f <fileNameTemplate> (-options)" << std::endl << std::endl;
+  std::cout << "     -p: Port to listen on, or a range of ports such as 56000-56031; give -p more than once for more ports (default = 56000)" << std::endl;
+  std::cout << "     -f: Template for the name of each connection's output file (default = receiver_%p_%c.dat), where" << std::endl;
+  std::cout << "           %p is the port, %c is the number of the connection on that port (from 0), %t is the UTC time the" << std::endl;
+  std::cout << "           connection was accepted (YYYYMMDD_HHMMSS), and %% is a %. Existing files are never overwritten: a" << std::endl;
+  std::cout << "           connection takes the next number whose file doesn't exist yet, or is closed if the template has no %c" << std::endl;
+  std::cout << "           (existing FIFOs and devices are written to)" << std::endl;
+  std::cout << "     -b: Number of bytes to read from a connection at a time (default = 1048576)" << std::endl;
+  std::cout << "     -t: Number of threads handling connections (default = 1)" << std::endl;
+  std::cout << "     -n: Most connections open at once; any more are closed as soon as they are accepted (default = 1024)" << std::endl;
+  std::cout << "     -S: Copy data with read and write instead of splicing it from the socket to the file through a pipe" << std::endl;
+  std::cout << "     -R: Size of a ring buffer, in MB, between reading each connection and writing its file with a thread of its own, so" << std::endl;
+  std::cout << "           the socket keeps being read while the disk is slow (default = 0, no ring buffer; implies -S)" << std::endl;
+  std::cout << "     -a: Number of bytes to allocate on disk for each file when it is opened, so a long recording isn't fragmented; the" << std::endl;
+  std::cout << "           file is cut back to the size of what was received when the connection ends (default = 0, allocate as written)" << std::endl;
+  std::cout << "     -D: Write files with O_DIRECT, bypassing the page cache, from aligned buffers (implies -S)" << std::endl << std::endl;
+  std::cout << "receiver runs until it is interrupted (SIGINT or SIGTERM), accepting any number of connections on each port and writing" << std::endl;
+  std::cout << "each to its own file." << std::endl << std::endl;
   return;
 }
 
-/* -- receiver ----------------------------------------------------------------------|
-** Listens to the specified port and writes the incoming data to the specified file. |
------------------------------------------------------------------------------------ */
-int main(int argc, char *argv[]) {
+// A port being listened on
+struct listener {
+  int port, socketFileDescriptor;
+  std::atomic<int> numConnections;
+};
 
-  int socketFileDescriptor, newSocketFileDescriptor, bytesRead, arg, port = 56000, blockSize = 8192, optval = 1;
-  socklen_t clientAddressLength;
-  char *buffer;
-  struct sockaddr_in serverAddress, clientAddress;
-  std::ofstream fifoFileDescriptor;
+struct endpoint;
 
-  // Read command line parameters
-  while ((arg = getopt(argc, argv, "b:f:p:h")) != -1) {
-    switch (arg) {
+// A connection being written to a file
+struct connection {
+  int socketFileDescriptor, fileDescriptor, port, number;
+  listener *portListener;
+  std::string address, fileName;
+  long long bytesWritten;
+  std::chrono::steady_clock::time_point startTime;
+  // CPU time the threads have spent on this connection
+  double cpuSeconds;
+  // The pipe data is spliced through, if splice is being used
+  bool useSplice;
+  int pipeFileDescriptors[2];
+  int pipeSize;
+  // Bytes spliced into the pipe and not yet into the file. They are left there while the file is a full FIFO, and the socket isn't
+  // read until the FIFO has taken them (waitingForFile)
+  ssize_t pipeBytes;
+  bool waitingForFile;
+  // Whether the file is written with O_DIRECT, and, without a ring buffer, the aligned buffer of what has been read and not yet
+  // written, as O_DIRECT writes whole aligned blocks
+  bool direct;
+  char *directBuffer;
+  size_t directBufferSize, directBytes;
+  // Whether the file has to be cut back to the size of what was received when it is closed, as it was allocated ahead or written
+  // in whole O_DIRECT blocks
+  bool cutToSize;
+  // With a ring buffer (-R), what has been read from the socket and not yet written to the file. ringHead and ringTail count
+  // every byte ever put in and taken out: only the epoll thread moves the head, and only the writer thread moves the tail
+  char *ring;
+  size_t ringSize;
+  std::atomic<unsigned long long> ringHead, ringTail;
+  // The epoll instance and endpoint of the connection, for the writer thread to start reading the socket again
+  int epollFileDescriptor;
+  endpoint *streamEndpoint;
+  // readingPaused is set while the socket isn't being read because the ring is full; endOfStream once nothing more will be put in
+  std::atomic<bool> readingPaused, writerWaiting, endOfStream, writerDone;
+  std::atomic<int> writeError;
+  std::mutex writerMutex;
+  std::condition_variable wakeWriter;
+  std::thread writer;
+  std::string endReason;
+  // How the ring buffer coped: the most it held, the times (and seconds) reading was paused, and the slowest write to disk
+  size_t ringHighWater;
+  int numPauses, numSlowWrites;
+  std::chrono::steady_clock::time_point pauseStart;
+  double pausedSeconds, slowestWrite, writerCPUSeconds;
+};
 
-      case 'b':
-        blockSize = atoi(optarg);
-        break;
+// What an epoll event refers to: a listening socket or a connection
+struct endpoint {
+  bool isListener;
+  listener *portListener;
+  connection *streamConnection;
+};
 
-      case 'f':
-        fifoFileDescriptor.open(optarg, std::ofstream::binary);
-        if (!fifoFileDescriptor.is_open()) {
-          std::cerr << "Failed to open fifo " << optarg << " to read!" << std::endl;
-          exit(1);
+// Set when SIGINT or SIGTERM arrives, so the threads finish what they are writing and stop
+std::atomic<bool> stopRequested(false);
+
+void requestStop(int) {
+  stopRequested = true;
+}
+
+// Messages come from several threads, so each is written whole
+std::mutex messageMutex;
+
+void logMessage(const std::string &message) {
+  std::lock_guard<std::mutex> lock(messageMutex);
+  std::cout << message << std::endl;
+}
+
+// Expand a file name template for a connection: %p is the port, %c the connection number, %t the UTC time, and %% a %
+std::string expandFileName(const char *fileNameTemplate, int port, int number) {
+  std::string fileName;
+  char timeString[32];
+  const time_t now = time(NULL);
+  struct tm utc;
+  gmtime_r(&now, &utc);
+  strftime(timeString, sizeof(timeString), "%Y%m%d_%H%M%S", &utc);
+  for (const char *character = fileNameTemplate; *character != '\0'; character++) {
+    if (*character == '%' && character[1] != '\0') {
+      character++;
+      if (*character == 'p') {
+        fileName += std::to_string(port);
+      } else if (*character == 'c') {
+        fileName += std::to_string(number);
+      } else if (*character == 't') {
+        fileName += timeString;
+      } else {
+        fileName += *character;
+      }
+    } else {
+      fileName += *character;
+    }
+  }
+  return fileName;
+}
+
+// Whether a file name template numbers connections (has a %c), so that each can be given a file of its own
+bool templateNumbersConnections(const char *fileNameTemplate) {
+  for (const char *character = fileNameTemplate; *character != '\0'; character++) {
+    if (*character == '%' && character[1] != '\0') {
+      character++;
+      if (*character == 'c') {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+// Size and alignment of O_DIRECT writes, in memory and in the file; 4096 bytes suits the logical block size of any disk
+const size_t directAlignment = 4096;
+
+// Write all of a block to a connection's file, however many calls it takes; returns false on an error
+// If the file turns out not to take O_DIRECT writes, it is switched to ordinary writes, and the block is carried on with
+bool writeFile(connection *stream, const char *data, size_t length) {
+  while (length > 0) {
+    const ssize_t bytesWritten = write(stream->fileDescriptor, data, length);
+    if (bytesWritten < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EINVAL && stream->direct) {
+        stream->direct = false;
+        if (fcntl(stream->fileDescriptor, F_SETFL, fcntl(stream->fileDescriptor, F_GETFL) & ~O_DIRECT) == 0) {
+          continue;
         }
-        break;
+      }
+      return false;
+    }
+    data += bytesWritten;
+    length -= bytesWritten;
+  }
+  return true;
+}
 
-      case 'p':
-        port = atoi(optarg);
-        break;
+// CPU time used by the calling thread, in seconds
+double threadCPUTime() {
+  struct timespec time;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+  return time.tv_sec + time.tv_nsec * 1e-9;
+}
 
-      case 'h':
-        usage();
-        exit(0);
+// Set up a connection to splice its data to its file through a pipe holding up to blockSize bytes (or as much as the system allows)
+// Returns false if a pipe can't be made, in which case the connection uses read and write
+bool setupSplice(connection *stream, int blockSize) {
+  if (pipe2(stream->pipeFileDescriptors, O_NONBLOCK | O_CLOEXEC) != 0) {
+    return false;
+  }
+  // Ask for a pipe as large as a block; if that is more than /proc/sys/fs/pipe-max-size allows, the pipe keeps the size it has
+  fcntl(stream->pipeFileDescriptors[1], F_SETPIPE_SZ, blockSize);
+  stream->pipeSize = fcntl(stream->pipeFileDescriptors[1], F_GETPIPE_SZ);
+  if (stream->pipeSize <= 0) {
+    close(stream->pipeFileDescriptors[0]);
+    close(stream->pipeFileDescriptors[1]);
+    return false;
+  }
+  return true;
+}
 
-      default:
-        return 0;
-        break;
+// Write the last of what is in a connection's O_DIRECT buffer, as a whole aligned block; the file is cut back to size when it is closed
+// If the file has been switched to ordinary writes, only what is in the buffer is written
+bool flushDirectBuffer(connection *stream) {
+  if (stream->directBytes == 0) {
+    return true;
+  }
+  if (!stream->direct) {
+    const size_t bytesLeft = stream->directBytes;
+    stream->directBytes = 0;
+    return writeFile(stream, stream->directBuffer, bytesLeft);
+  }
+  const size_t alignedBytes = (stream->directBytes + directAlignment - 1) / directAlignment * directAlignment;
+  memset(stream->directBuffer + stream->directBytes, 0, alignedBytes - stream->directBytes);
+  stream->directBytes = 0;
+  return writeFile(stream, stream->directBuffer, alignedBytes);
+}
 
+void closeSplice(connection *stream) {
+  stream->pipeBytes = 0;
+  if (stream->useSplice) {
+    close(stream->pipeFileDescriptors[0]);
+    close(stream->pipeFileDescriptors[1]);
+    stream->useSplice = false;
+  }
+}
+
+// Splice what is in a connection's pipe into its file
+// If the file can't be spliced to (some filesystems and devices don't support it), whatever is in the pipe is written from 'buffer', and the
+// connection carries on with read and write. If the file is a full FIFO, which splice won't wait on as the pipe doesn't block, the rest is
+// left in the pipe (pipeBytes) for when the FIFO can take more
+// Returns the number of bytes written to the file, or -1 on an error, setting 'failure' to what failed
+ssize_t emptyPipe(connection *stream, char *buffer, int blockSize, const char *&failure) {
+  ssize_t bytesCopied = 0;
+  while (stream->pipeBytes > 0) {
+    const ssize_t bytesWritten = splice(stream->pipeFileDescriptors[0], NULL, stream->fileDescriptor, NULL, stream->pipeBytes, SPLICE_F_MOVE);
+    if (bytesWritten >= 0) {
+      stream->pipeBytes -= bytesWritten;
+      bytesCopied += bytesWritten;
+      continue;
+    }
+    if (errno == EINTR) {
+      continue;
+    }
+    if (errno == EAGAIN) {
+      return bytesCopied;
+    }
+    if (errno != EINVAL && errno != ENOSYS) {
+      failure = "failed writing to file";
+      return -1;
+    }
+    // The file can't be spliced to, so empty the pipe into it by hand, and use read and write from now on
+    while (stream->pipeBytes > 0) {
+      const ssize_t bytesRead = read(stream->pipeFileDescriptors[0], buffer, std::min((ssize_t) blockSize, stream->pipeBytes));
+      if (bytesRead <= 0 || !writeFile(stream, buffer, bytesRead)) {
+        failure = "failed writing to file";
+        return -1;
+      }
+      stream->pipeBytes -= bytesRead;
+      bytesCopied += bytesRead;
     }
+    closeSplice(stream);
   }
+  return bytesCopied;
+}
 
-  // Print usage if user has not specified any options
-  if (argc == 1) {
-    usage();
-    return 0;
+// Copy a block of what has arrived on a connection to its file. With splice, the data goes from the socket into the pipe and from the pipe
+// into the file without ever being copied into this process; otherwise it is read into 'buffer' and written from there
+// Returns the number of bytes written to the file, 0 at the end of the stream (or if all of the block is left in the pipe for a full FIFO,
+// with pipeBytes set), or -1 on an error (with errno EAGAIN if nothing was waiting), setting 'failure' to what failed
+ssize_t copyBlock(connection *stream, char *buffer, int blockSize, const char *&failure) {
+
+  if (stream->useSplice) {
+    const ssize_t bytesSpliced = splice(stream->socketFileDescriptor, NULL, stream->pipeFileDescriptors[1], NULL, stream->pipeSize, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (bytesSpliced < 0 && (errno == EINVAL || errno == ENOSYS)) {
+      // The socket can't be spliced from, so fall back to read and write
+      closeSplice(stream);
+      return copyBlock(stream, buffer, blockSize, failure);
+    }
+    if (bytesSpliced <= 0) {
+      failure = "failed reading from socket";
+      return bytesSpliced;
+    }
+    stream->pipeBytes = bytesSpliced;
+    return emptyPipe(stream, buffer, blockSize, failure);
+  }
+
+  // With O_DIRECT, what has been read is gathered in the connection's aligned buffer, and only whole aligned blocks are written
+  if (stream->directBuffer != NULL) {
+    const ssize_t bytesRead = read(stream->socketFileDescriptor, stream->directBuffer + stream->directBytes, stream->directBufferSize - stream->directBytes);
+    if (bytesRead <= 0) {
+      failure = "failed reading from socket";
+      return bytesRead;
+    }
+    stream->directBytes += bytesRead;
+    const size_t alignedBytes = stream->directBytes / directAlignment * directAlignment;
+    if (alignedBytes > 0) {
+      if (!writeFile(stream, stream->directBuffer, alignedBytes)) {
+        failure = "failed writing to file";
+        return -1;
+      }
+      stream->directBytes -= alignedBytes;
+      memmove(stream->directBuffer, stream->directBuffer + alignedBytes, stream->directBytes);
+    }
+    return bytesRead;
+  }
+
+  const ssize_t bytesRead = read(stream->socketFileDescriptor, buffer, blockSize);
+  if (bytesRead <= 0) {
+    failure = "failed reading from socket";
+    return bytesRead;
+  }
+  if (!writeFile(stream, buffer, bytesRead)) {
+    failure = "failed writing to file";
+    return -1;
+  }
+  return bytesRead;
+
+}
+
+// A write to disk taking longer than this many seconds is counted as slow
+const double slowWriteSeconds = 0.1;
+
+// Start reading a connection whose ring buffer was full again; called by whichever thread finds it paused first
+void resumeReading(connection *stream) {
+  struct epoll_event event;
+  event.events = EPOLLIN | EPOLLRDHUP;
+  event.data.ptr = stream->streamEndpoint;
+  stream->pausedSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - stream->pauseStart).count();
+  epoll_ctl(stream->epollFileDescriptor, EPOLL_CTL_MOD, stream->socketFileDescriptor, &event);
+}
+
+bool ringFull(connection *stream) {
+  return stream->ringHead.load() - stream->ringTail.load() >= stream->ringSize;
+}
+
+// Stop reading a connection whose ring buffer is full, leaving the data in the socket (and the sender waiting) until the writer
+// thread has made room. The socket is taken out of epoll before readingPaused is set, so the writer can only put it back after;
+// and if the writer made room before seeing readingPaused, the ring is no longer full here and reading starts again at once
+// EPOLLONESHOT stops a hangup or error on the socket from waking the epoll thread over and over until then
+void pauseReading(connection *stream) {
+  struct epoll_event event;
+  event.events = EPOLLONESHOT;
+  event.data.ptr = stream->streamEndpoint;
+  epoll_ctl(stream->epollFileDescriptor, EPOLL_CTL_MOD, stream->socketFileDescriptor, &event);
+  stream->numPauses++;
+  stream->pauseStart = std::chrono::steady_clock::now();
+  stream->readingPaused = true;
+  if (!ringFull(stream) && stream->readingPaused.exchange(false)) {
+    resumeReading(stream);
+  }
+}
+
+// Wake the writer thread if it is waiting for data; it checks for data after setting writerWaiting, so it can't miss any
+void wakeWriter(connection *stream) {
+  if (stream->writerWaiting) {
+    std::lock_guard<std::mutex> lock(stream->writerMutex);
+    stream->wakeWriter.notify_one();
+  }
+}
+
+// Read up to a block from a connection into the free space of its ring buffer, without wrapping round the end of the ring
+// The head is stored sequentially consistently, as wakeWriter relies on it being seen before writerWaiting is looked at
+// Returns the number of bytes read, 0 at the end of the stream, or -1 on an error (with errno EAGAIN if nothing was waiting)
+ssize_t fillRing(connection *stream, int blockSize) {
+  const unsigned long long head = stream->ringHead.load(std::memory_order_relaxed), tail = stream->ringTail.load(std::memory_order_acquire);
+  const size_t offset = head % stream->ringSize;
+  const size_t length = std::min({(size_t) (stream->ringSize - (head - tail)), stream->ringSize - offset, (size_t) blockSize});
+  const ssize_t bytesRead = read(stream->socketFileDescriptor, stream->ring + offset, length);
+  if (bytesRead > 0) {
+    stream->ringHead.store(head + bytesRead);
+    stream->ringHighWater = std::max(stream->ringHighWater, (size_t) (head + bytesRead - tail));
+    wakeWriter(stream);
+  }
+  return bytesRead;
+}
+
+// The writer thread of a connection with a ring buffer: writes whatever the epoll thread has put in the ring to the file, a block at a
+// time, until the end of the stream has been reached and the ring is empty, or a write fails
+// With O_DIRECT, only whole aligned blocks are written until the end of the stream, as the ring is aligned and a whole number of
+// blocks long; the last few bytes are written as a whole block, and the file is cut back to size when it is closed
+void drainRing(connection *stream, int blockSize) {
+
+  const size_t writeSize = stream->direct ? std::max(directAlignment, blockSize / directAlignment * directAlignment) : blockSize;
+
+  while (true) {
+
+    const unsigned long long tail = stream->ringTail.load(std::memory_order_relaxed);
+    const unsigned long long minimumWrite = stream->direct ? directAlignment : 1;
+    // endOfStream is set after the last of the data is put in, so it is checked before looking for data
+    const bool finished = stream->endOfStream;
+    const unsigned long long head = stream->ringHead.load(std::memory_order_acquire);
+    if (head - tail < minimumWrite && !finished) {
+      std::unique_lock<std::mutex> lock(stream->writerMutex);
+      stream->writerWaiting = true;
+      stream->wakeWriter.wait_for(lock, std::chrono::milliseconds(100), [&]() { return stream->ringHead.load() - tail >= minimumWrite || stream->endOfStream; });
+      stream->writerWaiting = false;
+      continue;
+    }
+    if (head == tail) {
+      break;
+    }
+
+    const size_t offset = tail % stream->ringSize;
+    size_t length = std::min({(size_t) (head - tail), stream->ringSize - offset, writeSize}), writeLength = length;
+    if (stream->direct) {
+      if (length >= directAlignment) {
+        length = writeLength = length / directAlignment * directAlignment;
+      } else {
+        writeLength = directAlignment;
+      }
+    }
+    const auto writeStart = std::chrono::steady_clock::now();
+    if (!writeFile(stream, stream->ring + offset, writeLength)) {
+      stream->writeError = errno;
+      break;
+    }
+    const double writeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - writeStart).count();
+    stream->slowestWrite = std::max(stream->slowestWrite, writeSeconds);
+    if (writeSeconds > slowWriteSeconds) {
+      stream->numSlowWrites++;
+    }
+    stream->bytesWritten += length;
+    stream->ringTail.store(tail + length);
+
+    if (stream->readingPaused && stream->readingPaused.exchange(false)) {
+      resumeReading(stream);
+    }
+
+  }
+
+  // If the epoll thread is waiting for room that will never come, start it reading again so it finds out the write failed
+  if (stream->readingPaused.exchange(false)) {
+    resumeReading(stream);
+  }
+  stream->writerCPUSeconds = threadCPUTime();
+  stream->writerDone = true;
+
+}
+
+// Open the file of a connection to write, with O_DIRECT if asked to and the file allows it. The file is opened without blocking, as
+// opening a FIFO nothing is reading yet would otherwise hold up every connection of the thread; that fails with ENXIO, and is tried
+// again later. Once open, the file is switched to blocking writes
+// An existing ordinary file is never overwritten, as it is likely an earlier observation (the connection numbers start from 0 again
+// each time receiver is started) or another port's connection: the connection takes the next number instead, if the template has a
+// %c, and otherwise fails with EEXIST. Existing FIFOs and devices are written to, as they are meant to be
+// Returns false if the file couldn't be opened, with errno set
+bool openOutputFile(connection *stream, const char *fileNameTemplate, bool directIO) {
+  while (true) {
+    struct stat fileStatus;
+    const bool specialFile = stat(stream->fileName.c_str(), &fileStatus) == 0 && !S_ISREG(fileStatus.st_mode);
+    stream->fileDescriptor = open(stream->fileName.c_str(), O_WRONLY | O_NONBLOCK | (specialFile ? 0 : O_CREAT | O_EXCL), 0644);
+    if (stream->fileDescriptor >= 0 || errno != EEXIST || !templateNumbersConnections(fileNameTemplate)) {
+      break;
+    }
+    stream->number = stream->portListener->numConnections++;
+    stream->fileName = expandFileName(fileNameTemplate, stream->port, stream->number);
+  }
+  if (stream->fileDescriptor < 0) {
+    return false;
+  }
+  const int flags = fcntl(stream->fileDescriptor, F_GETFL) & ~O_NONBLOCK;
+  stream->direct = directIO && fcntl(stream->fileDescriptor, F_SETFL, flags | O_DIRECT) == 0;
+  if (directIO && !stream->direct) {
+    logMessage("receiver at port " + std::to_string(stream->port) + ": " + stream->fileName + " can't be written with O_DIRECT, so writing it through the page cache");
   }
+  if (!stream->direct && fcntl(stream->fileDescriptor, F_SETFL, flags) != 0) {
+    const int error = errno;
+    close(stream->fileDescriptor);
+    stream->fileDescriptor = -1;
+    errno = error;
+    return false;
+  }
+  return true;
+}
 
-  // Allocate buffer
-  buffer = (char *) malloc(sizeof(char) * blockSize);
+// Open a socket listening on a port, which doesn't block when there is nothing to accept
+int openListener(int port) {
 
-  // Open socket
-  socketFileDescriptor = socket(AF_INET, SOCK_STREAM, 0);
+  int socketFileDescriptor, optval = 1;
+  struct sockaddr_in serverAddress;
+
+  socketFileDescriptor = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
   if (socketFileDescriptor < 0) {
     std::cerr << "Error opening socket!" << std::endl;
     exit(1);
@@ -86,53 +514,504 @@ int main(int argc, char *argv[]) {
     std::cerr << "Error turning off socket linger!" << std::endl;
   }
 
-  bzero((char *) &serverAddress, sizeof(serverAddress));
+  memset(&serverAddress, 0, sizeof(serverAddress));
   serverAddress.sin_family = AF_INET;
   serverAddress.sin_addr.s_addr = INADDR_ANY;
   serverAddress.sin_port = htons(port);
   if (bind(socketFileDescriptor, (struct sockaddr *) &serverAddress, sizeof(serverAddress)) < 0) {
-    std::cerr << "Error binding socket!" << std::endl;
+    std::cerr << "Error binding socket to port " << port << "!" << std::endl;
     exit(1);
   }
 
   // Listen to socket
-  if (listen(socketFileDescriptor, 5) < 0) {
-    std::cerr << "Error listening to socket!" << std::endl;
+  if (listen(socketFileDescriptor, 64) < 0) {
+    std::cerr << "Error listening to socket on port " << port << "!" << std::endl;
     exit(1);
   }
 
-  std::cout << "receiver at port " << port << " opened" << std::endl;
+  return socketFileDescriptor;
+
+}
+
+/* -- receiver -------------------------------------------------------------------------------------------------------------
+** Listens on any number of ports and writes the data of every connection to each to its own file, named from a template,  |
+** until it is interrupted, so one process can take the data of a whole multibeam backend, observation after observation.  |
+**                                                                                                                         |
+** Each of the -t threads has its own epoll instance, which holds every listening socket (with EPOLLEXCLUSIVE, so a new    |
+** connection only wakes one thread) and the connections that thread accepted. A connection is only ever handled by the    |
+** thread that accepted it, so connections need no locking.                                                                |
+**                                                                                                                         |
+** Data is spliced from each socket into a pipe and from the pipe into the file, so the kernel moves it without it being   |
+** copied into and out of this process. Where splice isn't supported (or with -S), it is read and written in blocks.       |
+**                                                                                                                         |
+** With a ring buffer (-R), the epoll threads only read each connection into its own ring, which a writer thread for that  |
+** connection empties into the file, so the socket keeps being read while the disk is slow, instead of the sender being    |
+** held up. Only the epoll thread moves the head of a ring and only the writer moves its tail, so they pass data without   |
+** locking. When a ring is full, reading the socket pauses until the writer makes room.                                    |
+**                                                                                                                         |
+** With -a, each file is allocated on disk in one go when it is opened, so files written side by side aren't interleaved,  |
+** and with -D it is written with O_DIRECT, so a recording doesn't push what other programs are reading out of the page    |
+** cache. O_DIRECT writes are whole 4096-byte blocks from aligned memory, so the last block is padded; either way, the     |
+** file is cut back to the size of what was received when the connection ends.                                             |
+------------------------------------------------------------------------------------------------------------------------ */
+int main(int argc, char *argv[]) {
+
+  int arg, blockSize = 1 << 20, numThreads = 1, maxConnections = 1024, allowSplice = 1, directIO = 0;
+  double ringMegabytes = 0.0;
+  long long preallocateBytes = 0;
+  const char *fileNameTemplate = "receiver_%p_%c.dat";
+  std::vector<int> ports;
+
+  // Print usage if user has not specified any options
+  if (argc == 1) {
+    usage();
+    return 0;
+  }
+
+  // Read command line parameters
+  while ((arg = getopt(argc, argv, "a:b:Df:hn:p:R:St:")) != -1) {
+    switch (arg) {
+
+      case 'a':
+        preallocateBytes = (long long) atof(optarg);
+        break;
+
+      case 'b':
+        blockSize = atoi(optarg);
+        break;
+
+      case 'D':
+        directIO = 1;
+        break;
+
+      case 'f':
+        fileNameTemplate = optarg;
+        break;
+
+      case 'n':
+        maxConnections = atoi(optarg);
+        break;
+
+      case 'p': {
+        int firstPort, lastPort;
+        const int numRead = sscanf(optarg, "%d-%d", &firstPort, &lastPort);
+        if (numRead < 1 || (numRead == 2 && lastPort < firstPort)) {
+          std::cerr << "Could not read port " << optarg << "!" << std::endl;
+          exit(1);
+        }
+        for (int port = firstPort; port <= (numRead == 2 ? lastPort : firstPort); port++) {
+          ports.push_back(port);
+        }
+        break;
+      }
+
+      case 'R':
+        ringMegabytes = atof(optarg);
+        break;
 
-  clientAddressLength = sizeof(clientAddress);
-  newSocketFileDescriptor = accept(socketFileDescriptor, (struct sockaddr *) &clientAddress, &clientAddressLength);
+      case 'S':
+        allowSplice = 0;
+        break;
 
-  bzero(buffer, blockSize);
-  if (newSocketFileDescriptor < 0) {
-    std::cerr << "Error accepting connection from socket!" << std::endl;
+      case 't':
+        numThreads = atoi(optarg);
+        break;
+
+      case 'h':
+        usage();
+        exit(0);
+
+      default:
+        return 0;
+        break;
+
+    }
+  }
+
+  if (ports.size() == 0) {
+    ports.push_back(56000);
+  }
+
+  if (blockSize < 1 || numThreads < 1 || maxConnections < 1) {
+    std::cerr << "The block size, number of threads, and most connections must all be at least 1!" << std::endl;
     exit(1);
   }
 
-  while (true) {
-    bytesRead = read(newSocketFileDescriptor, buffer, blockSize);
-    if (bytesRead < 0) {
-      std::cerr << "Error reading from socket!" << std::endl;
+  // The ring buffer is a whole number of aligned blocks, so it can be written with O_DIRECT
+  const size_t ringSize = (size_t) ceil(ringMegabytes * 1048576.0 / directAlignment) * directAlignment;
+  if (ringMegabytes < 0.0) {
+    std::cerr << "The ring buffer size must be positive, or 0 for no ring buffer!" << std::endl;
+    exit(1);
+  }
+
+  if (preallocateBytes < 0) {
+    std::cerr << "The number of bytes to allocate for each file can't be negative!" << std::endl;
+    exit(1);
+  }
+
+  // Finish cleanly when interrupted, and don't die if a client goes away while being written to
+  signal(SIGINT, requestStop);
+  signal(SIGTERM, requestStop);
+  signal(SIGPIPE, SIG_IGN);
+
+  // Open a socket on each port
+  std::vector<listener> listeners(ports.size());
+  std::vector<endpoint> listenerEndpoints(ports.size());
+  for (size_t i = 0; i < ports.size(); i++) {
+    listeners[i].port = ports[i];
+    listeners[i].socketFileDescriptor = openListener(ports[i]);
+    listeners[i].numConnections = 0;
+    listenerEndpoints[i] = {true, &listeners[i], NULL};
+    std::cout << "receiver at port " << ports[i] << " opened" << std::endl;
+  }
+
+  std::atomic<int> numOpenConnections(0);
+
+  auto handleConnections = [&](int thread) {
+
+    struct epoll_event event, events[64];
+    std::vector<char> buffer(blockSize);
+    std::vector<endpoint*> openEndpoints;
+
+    const int epollFileDescriptor = epoll_create1(0);
+    if (epollFileDescriptor < 0) {
+      std::cerr << "Error creating epoll instance!" << std::endl;
       exit(1);
     }
-    fifoFileDescriptor.write(buffer, sizeof(char) * bytesRead);
-    if (bytesRead == 0) {
-      break;
+    for (endpoint &listenerEndpoint : listenerEndpoints) {
+      event.events = EPOLLIN | EPOLLEXCLUSIVE;
+      event.data.ptr = &listenerEndpoint;
+      if (epoll_ctl(epollFileDescriptor, EPOLL_CTL_ADD, listenerEndpoint.portListener->socketFileDescriptor, &event) != 0) {
+        std::cerr << "Error adding port " << listenerEndpoint.portListener->port << " to epoll instance!" << std::endl;
+        exit(1);
+      }
     }
-  }
-  fifoFileDescriptor.close();
-  close(newSocketFileDescriptor);
-  std::cout << "receiver at port " << port << " finished" << std::endl;
 
-  close(socketFileDescriptor);
+    // With a ring buffer, stop reading a connection and leave its writer thread to empty the ring
+    int numEnding = 0;
+    auto endStream = [&](connection *stream, const std::string &reason) {
+      epoll_ctl(epollFileDescriptor, EPOLL_CTL_DEL, stream->socketFileDescriptor, NULL);
+      stream->endReason = reason;
+      stream->endOfStream = true;
+      wakeWriter(stream);
+      numEnding++;
+    };
+
+    // Close a connection and its file, and report how much was written; with a ring buffer, wait for the writer thread to empty it first
+    auto finishConnection = [&](endpoint *connectionEndpoint, std::string reason) {
+      connection *stream = connectionEndpoint->streamConnection;
+      std::string ringReport;
+      epoll_ctl(epollFileDescriptor, EPOLL_CTL_DEL, stream->socketFileDescriptor, NULL);
+      if (stream->waitingForFile) {
+        epoll_ctl(epollFileDescriptor, EPOLL_CTL_DEL, stream->fileDescriptor, NULL);
+      }
+      if (stream->ring != NULL) {
+        if (!stream->endOfStream) {
+          endStream(stream, reason);
+        }
+        stream->writer.join();
+        numEnding--;
+        reason = stream->endReason;
+        if (stream->writeError != 0) {
+          reason = std::string("failed writing to file (") + strerror(stream->writeError) + ")";
+        }
+        stream->cpuSeconds += stream->writerCPUSeconds;
+        ringReport = ", ring buffer held at most " + std::to_string(stream->ringHighWater/1048576.0) + " of " + std::to_string(stream->ringSize/1048576.0) + " MB, reading paused " +
+                     std::to_string(stream->numPauses) + " times for " + std::to_string(stream->pausedSeconds) + " s, " + std::to_string(stream->numSlowWrites) + " writes slower than " +
+                     std::to_string(slowWriteSeconds) + " s, slowest " + std::to_string(stream->slowestWrite) + " s";
+        free(stream->ring);
+      }
+      if (stream->directBuffer != NULL) {
+        if (!flushDirectBuffer(stream)) {
+          reason = std::string("failed writing to file (") + strerror(errno) + ")";
+        }
+        free(stream->directBuffer);
+      }
+      const bool direct = stream->direct;
+      if (stream->cutToSize && ftruncate(stream->fileDescriptor, stream->bytesWritten) != 0) {
+        logMessage("receiver at port " + std::to_string(stream->port) + ": failed to cut " + stream->fileName + " back to " + std::to_string(stream->bytesWritten) + " bytes (" + strerror(errno) + ")");
+      }
+      close(stream->socketFileDescriptor);
+      close(stream->fileDescriptor);
+      const bool spliced = stream->useSplice;
+      closeSplice(stream);
+      const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - stream->startTime).count();
+      logMessage("receiver at port " + std::to_string(stream->port) + ": connection " + std::to_string(stream->number) + " from " + stream->address + " " + reason + ", wrote " +
+                 std::to_string(stream->bytesWritten) + " bytes to " + stream->fileName + " in " + std::to_string(seconds) + " s (" + std::to_string(stream->bytesWritten/1e6/std::max(seconds, 1e-9)) + " MB/s, " +
+                 std::to_string(stream->cpuSeconds) + " s CPU, " + std::to_string(100.0 * stream->cpuSeconds/std::max(seconds, 1e-9)) + "% of a core, " + (spliced ? "spliced" : "read and write") + (direct ? " with O_DIRECT" : "") + ringReport + ")");
+      openEndpoints.erase(std::find(openEndpoints.begin(), openEndpoints.end(), connectionEndpoint));
+      delete stream;
+      delete connectionEndpoint;
+      numOpenConnections--;
+    };
+
+    // Stop reading a connection while its file is a full FIFO, and wait for the FIFO to take what is left in the pipe instead: the socket
+    // is disarmed (EPOLLONESHOT keeps a hangup from waking the thread over and over), and the file is added to the epoll instance
+    auto waitForFile = [&](endpoint *connectionEndpoint) {
+      connection *stream = connectionEndpoint->streamConnection;
+      event.events = EPOLLONESHOT;
+      event.data.ptr = connectionEndpoint;
+      epoll_ctl(epollFileDescriptor, EPOLL_CTL_MOD, stream->socketFileDescriptor, &event);
+      event.events = EPOLLOUT;
+      if (epoll_ctl(epollFileDescriptor, EPOLL_CTL_ADD, stream->fileDescriptor, &event) != 0) {
+        return false;
+      }
+      stream->waitingForFile = true;
+      return true;
+    };
+
+    // Start reading a connection again once its FIFO has taken everything in the pipe
+    auto stopWaitingForFile = [&](endpoint *connectionEndpoint) {
+      connection *stream = connectionEndpoint->streamConnection;
+      epoll_ctl(epollFileDescriptor, EPOLL_CTL_DEL, stream->fileDescriptor, NULL);
+      stream->waitingForFile = false;
+      event.events = EPOLLIN | EPOLLRDHUP;
+      event.data.ptr = connectionEndpoint;
+      epoll_ctl(epollFileDescriptor, EPOLL_CTL_MOD, stream->socketFileDescriptor, &event);
+    };
+
+    // Give up on a connection before its file has been opened, or before it has been added to the epoll instance
+    std::vector<connection*> pendingConnections;
+    auto abandonConnection = [&](connection *stream, const std::string &message) {
+      logMessage("receiver at port " + std::to_string(stream->port) + ": " + message + ", so closed connection " + std::to_string(stream->number) + " from " + stream->address);
+      close(stream->socketFileDescriptor);
+      if (stream->fileDescriptor >= 0) {
+        close(stream->fileDescriptor);
+      }
+      closeSplice(stream);
+      free(stream->ring);
+      free(stream->directBuffer);
+      delete stream->streamEndpoint;
+      delete stream;
+      numOpenConnections--;
+    };
+
+    // Why a connection's file couldn't be opened, from errno
+    auto openFailure = [&](connection *stream) {
+      if (errno == EEXIST) {
+        return stream->fileName + " already exists, and the file name template has no %c to number the files";
+      }
+      return "failed to open " + stream->fileName + " to write (" + strerror(errno) + ")";
+    };
+
+    // Set up a connection whose file has been opened, and start reading it
+    auto startConnection = [&](connection *stream) {
+      // Allocate the whole file up front, if asked to; this only makes sense for an ordinary file, and if the filesystem can't, the
+      // file is just allocated as it is written
+      struct stat fileStatus;
+      const bool regularFile = fstat(stream->fileDescriptor, &fileStatus) == 0 && S_ISREG(fileStatus.st_mode);
+      if (regularFile && preallocateBytes > 0 && fallocate(stream->fileDescriptor, 0, 0, preallocateBytes) != 0) {
+        logMessage("receiver at port " + std::to_string(stream->port) + ": failed to allocate " + std::to_string(preallocateBytes) + " bytes for " + stream->fileName + " (" + strerror(errno) + ")");
+      }
+      stream->cutToSize = regularFile && (preallocateBytes > 0 || stream->direct);
+      stream->useSplice = ringSize == 0 && !directIO && allowSplice && setupSplice(stream, blockSize);
+      // The ring buffer, or without one the buffer O_DIRECT writes are made from, is aligned for O_DIRECT
+      if ((ringSize > 0 && posix_memalign((void**) &stream->ring, directAlignment, ringSize) != 0) ||
+          (ringSize == 0 && stream->direct && posix_memalign((void**) &stream->directBuffer, directAlignment, stream->directBufferSize) != 0)) {
+        abandonConnection(stream, "failed to allocate a buffer");
+        return;
+      }
+      event.events = EPOLLIN | EPOLLRDHUP;
+      event.data.ptr = stream->streamEndpoint;
+      if (epoll_ctl(epollFileDescriptor, EPOLL_CTL_ADD, stream->socketFileDescriptor, &event) != 0) {
+        abandonConnection(stream, "error adding connection to epoll instance");
+        return;
+      }
+      if (ringSize > 0) {
+        stream->writer = std::thread(drainRing, stream, blockSize);
+      }
+      openEndpoints.push_back(stream->streamEndpoint);
+      logMessage("receiver at port " + std::to_string(stream->port) + ": connection " + std::to_string(stream->number) + " from " + stream->address + " writing to " + stream->fileName + " (thread " + std::to_string(thread) + ")");
+    };
+
+    while (!stopRequested) {
+
+      // Try again to open the files of connections waiting for something to read their FIFOs; until then, what they send waits in the socket
+      for (size_t i = 0; i < pendingConnections.size(); ) {
+        connection *stream = pendingConnections[i];
+        if (!openOutputFile(stream, fileNameTemplate, directIO) && errno == ENXIO) {
+          i++;
+          continue;
+        }
+        pendingConnections.erase(pendingConnections.begin() + i);
+        if (stream->fileDescriptor < 0) {
+          abandonConnection(stream, openFailure(stream));
+        } else {
+          startConnection(stream);
+        }
+      }
 
-  // Free buffer
-  free(buffer);
+      // Close the connections whose writer threads have finished, which they do at the end of the stream or if a write fails
+      for (size_t i = 0; i < openEndpoints.size(); ) {
+        connection *stream = openEndpoints[i]->streamConnection;
+        if (stream->ring != NULL && stream->writerDone) {
+          finishConnection(openEndpoints[i], stream->endReason);
+        } else {
+          i++;
+        }
+      }
+
+      // Wake up now and then to see if we have been asked to stop, often while writer threads are finishing, and every so often to try
+      // opening files again
+      const int numEvents = epoll_wait(epollFileDescriptor, events, 64, numEnding > 0 ? 10 : (pendingConnections.empty() ? 500 : 100));
+      if (numEvents < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        std::cerr << "Error waiting for epoll events!" << std::endl;
+        exit(1);
+      }
+
+      for (int i = 0; i < numEvents; i++) {
+
+        endpoint *thisEndpoint = (endpoint*) events[i].data.ptr;
+
+        // Accept every waiting connection on a port, opening a file for each
+        if (thisEndpoint->isListener) {
+          listener *portListener = thisEndpoint->portListener;
+          while (true) {
+            struct sockaddr_in clientAddress;
+            socklen_t clientAddressLength = sizeof(clientAddress);
+            const int socketFileDescriptor = accept4(portListener->socketFileDescriptor, (struct sockaddr *) &clientAddress, &clientAddressLength, SOCK_NONBLOCK);
+            if (socketFileDescriptor < 0) {
+              if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                logMessage("receiver at port " + std::to_string(portListener->port) + ": error accepting connection from socket!");
+              }
+              break;
+            }
+            char addressString[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, &clientAddress.sin_addr, addressString, sizeof(addressString));
+            if (numOpenConnections >= maxConnections) {
+              logMessage("receiver at port " + std::to_string(portListener->port) + ": closed connection from " + addressString + ", as " + std::to_string(maxConnections) + " are already open");
+              close(socketFileDescriptor);
+              continue;
+            }
+            connection *stream = new connection;
+            stream->socketFileDescriptor = socketFileDescriptor;
+            stream->fileDescriptor = -1;
+            stream->port = portListener->port;
+            stream->portListener = portListener;
+            stream->number = portListener->numConnections++;
+            stream->address = addressString;
+            stream->fileName = expandFileName(fileNameTemplate, stream->port, stream->number);
+            stream->bytesWritten = 0;
+            stream->startTime = std::chrono::steady_clock::now();
+            stream->cpuSeconds = 0.0;
+            stream->direct = false;
+            stream->useSplice = false;
+            stream->pipeBytes = 0;
+            stream->waitingForFile = false;
+            stream->directBuffer = NULL;
+            stream->directBufferSize = std::max(directAlignment, (blockSize + directAlignment - 1) / directAlignment * directAlignment);
+            stream->directBytes = 0;
+            stream->ring = NULL;
+            stream->ringSize = ringSize;
+            stream->ringHead = 0;
+            stream->ringTail = 0;
+            stream->epollFileDescriptor = epollFileDescriptor;
+            stream->streamEndpoint = new endpoint{false, NULL, stream};
+            stream->readingPaused = false;
+            stream->writerWaiting = false;
+            stream->endOfStream = false;
+            stream->writerDone = false;
+            stream->writeError = 0;
+            stream->ringHighWater = 0;
+            stream->numPauses = 0;
+            stream->numSlowWrites = 0;
+            stream->pausedSeconds = 0.0;
+            stream->slowestWrite = 0.0;
+            stream->writerCPUSeconds = 0.0;
+            numOpenConnections++;
+            if (openOutputFile(stream, fileNameTemplate, directIO)) {
+              startConnection(stream);
+            } else if (errno == ENXIO) {
+              logMessage("receiver at port " + std::to_string(stream->port) + ": connection " + std::to_string(stream->number) + " from " + stream->address + " waiting for something to read " + stream->fileName);
+              pendingConnections.push_back(stream);
+            } else {
+              abandonConnection(stream, openFailure(stream));
+            }
+          }
+          continue;
+        }
+
+        // Copy what has arrived on a connection to its file; copying one block per event keeps one busy connection from holding up the others
+        connection *stream = thisEndpoint->streamConnection;
+
+        // With a ring buffer, the block goes into the ring for the writer thread, and reading pauses while the ring is full
+        if (stream->ring != NULL) {
+          if (stream->endOfStream || stream->writerDone || ringFull(stream)) {
+            continue;
+          }
+          const double cpuStart = threadCPUTime();
+          const ssize_t bytesRead = fillRing(stream, blockSize);
+          stream->cpuSeconds += threadCPUTime() - cpuStart;
+          if (bytesRead < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+              endStream(stream, std::string("failed reading from socket (") + strerror(errno) + ")");
+            }
+            continue;
+          }
+          if (bytesRead == 0) {
+            endStream(stream, "finished");
+            continue;
+          }
+          if (ringFull(stream)) {
+            pauseReading(stream);
+          }
+          continue;
+        }
+
+        // While the file is a full FIFO, the event is the FIFO having room (or the reader of it going away), so give it what is in the pipe
+        const char *failure = "";
+        const double cpuStart = threadCPUTime();
+        const bool waitingForFile = stream->waitingForFile;
+        const ssize_t bytesCopied = waitingForFile ? emptyPipe(stream, &buffer[0], blockSize, failure) : copyBlock(stream, &buffer[0], blockSize, failure);
+        stream->cpuSeconds += threadCPUTime() - cpuStart;
+        if (bytesCopied < 0) {
+          if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            finishConnection(thisEndpoint, std::string(failure) + " (" + strerror(errno) + ")");
+          }
+          continue;
+        }
+        if (bytesCopied == 0 && stream->pipeBytes == 0 && !waitingForFile) {
+          finishConnection(thisEndpoint, "finished");
+          continue;
+        }
+        stream->bytesWritten += bytesCopied;
+        if (waitingForFile && stream->pipeBytes == 0) {
+          stopWaitingForFile(thisEndpoint);
+        } else if (!waitingForFile && stream->pipeBytes > 0 && !waitForFile(thisEndpoint)) {
+          finishConnection(thisEndpoint, std::string("failed waiting for ") + stream->fileName + " to take more (" + strerror(errno) + ")");
+        }
+
+      }
+
+    }
+
+    // Close whatever is still open when asked to stop
+    while (!openEndpoints.empty()) {
+      finishConnection(openEndpoints.back(), "interrupted");
+    }
+    for (connection *stream : pendingConnections) {
+      abandonConnection(stream, "interrupted before " + stream->fileName + " could be opened");
+    }
+    close(epollFileDescriptor);
+
+  };
+
+  std::vector<std::thread> threads;
+  for (int thread = 0; thread < numThreads; thread++) {
+    threads.push_back(std::thread(handleConnections, thread));
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  for (listener &portListener : listeners) {
+    close(portListener.socketFileDescriptor);
+  }
 
-  std::cout << "Exiting " << port << std::endl;
+  std::cout << "Exiting" << std::endl;
 
   return 0;
 
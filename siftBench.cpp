@@ -0,0 +1,394 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <getopt.h>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include "siftEngine.h"
+
+// External function to print help if needed
+void usage() {
+  std::cout << std::endl << "Usage: siftBench (-options)" << std::endl;
+  std::cout << "       siftBench (-options) -g CCLfile" << std::endl << std::endl;
+  std::cout << "     -g: Only write a synthetic CCL of -n candidates to this file" << std::endl;
+  std::cout << "     -n: Number of candidates in a synthetic CCL written with -g (default = 10000)" << std::endl;
+  std::cout << "     -F: Fraction of the candidates that are members of harmonic families; the rest are noise (default = 0.5)" << std::endl;
+  std::cout << "     -m: Highest integer harmonic in a family (default = 8)" << std::endl;
+  std::cout << "     -s: Random number seed (default = 1)" << std::endl;
+  std::cout << "     -a: Fewest candidates to benchmark (default = 1000)" << std::endl;
+  std::cout << "     -A: Most candidates to benchmark (default = 10000000)" << std::endl;
+  std::cout << "     -L: Most candidates to run the legacy algorithm on, as it takes O(n^2) time (default = 100000)" << std::endl;
+  std::cout << "     -t: Which tool's harmonics to use: sift, strongSift, or both (default = both)" << std::endl;
+  std::cout << "     -d: Match factor for DM comparison (default = 0.1)" << std::endl;
+  std::cout << "     -H: Maximum harmonic ratio to search (default = 8)" << std::endl;
+  std::cout << "     -p: Match factor for period comparison (default = 0.001)" << std::endl;
+  std::cout << "     -j: Number of threads for the sift engine (default = number of cores)" << std::endl << std::endl;
+  std::cout << "The benchmark sifts synthetic CCLs with 10 times more candidates at each step, from -a to -A, with the algorithm sift and" << std::endl;
+  std::cout << "strongSift used to have (up to -L candidates) and with siftEngine.h, checks that both give exactly the same groups, and" << std::endl;
+  std::cout << "reports the time each takes. It then checks that known source matching agrees with comparing every harmonic." << std::endl << std::endl;
+}
+
+// Write a synthetic CCL of 'numCands' candidates, in the layout sift reads (S/N, period(error), two unused columns, and DM), to 'outfile'
+// and/or parse it into 'ccl', so the candidates have exactly the values sift would read from the file
+// A fraction 'familyFraction' of the candidates come from pulsars, each seen at some of its harmonics (1 to maxHarm, 1/2, 1/3, 2/3, and 3/2)
+// with a little scatter in period and DM and a lower S/N at higher harmonics; the rest are noise spread over periods from 1 ms to 10 s
+void generateCCL(long long numCands, double familyFraction, int maxHarm, unsigned int seed, std::ostream *outfile, candidateList *ccl) {
+
+  char line[128];
+  std::mt19937_64 randomNumGenerator(seed);
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  std::normal_distribution<double> normal(0.0, 1.0);
+  std::vector<double> familyRatios;
+  double period = 0.0, dm = 0.0, snr = 0.0;
+  size_t nextRatio = 0;
+
+  const long long numFamilyCands = (long long) (familyFraction * numCands);
+  for (long long cand = 0; cand < numCands; cand++) {
+
+    if (cand < numFamilyCands) {
+      // Start a new pulsar once the last one's harmonics are used up
+      if (nextRatio == familyRatios.size()) {
+        period = pow(10.0, -2.5 + 3.0 * uniform(randomNumGenerator));
+        dm = 5.0 + 995.0 * uniform(randomNumGenerator);
+        snr = 8.0 + 92.0 * uniform(randomNumGenerator);
+        familyRatios.assign(1, 1.0);
+        for (int harmonic = 2; harmonic <= maxHarm; harmonic++) {
+          if (uniform(randomNumGenerator) < 0.5) {
+            familyRatios.push_back(harmonic);
+          }
+        }
+        for (double ratio : {1.0/2.0, 1.0/3.0, 2.0/3.0, 3.0/2.0}) {
+          if (uniform(randomNumGenerator) < 0.5) {
+            familyRatios.push_back(ratio);
+          }
+        }
+        nextRatio = 0;
+      }
+      const double ratio = familyRatios[nextRatio++];
+      snprintf(line, sizeof(line), "%.6f %.9f(%d) %.3f %.3f %.2f\n", snr/sqrt(ratio) * (0.7 + 0.3 * uniform(randomNumGenerator)), period/ratio * (1.0 + 2e-4 * normal(randomNumGenerator)),
+               1 + (int) (9 * uniform(randomNumGenerator)), uniform(randomNumGenerator), uniform(randomNumGenerator), std::max(0.0, dm * (1.0 + 0.03 * normal(randomNumGenerator))));
+    } else {
+      snprintf(line, sizeof(line), "%.6f %.9f(%d) %.3f %.3f %.2f\n", 5.0 + 7.0 * uniform(randomNumGenerator), pow(10.0, -3.0 + 4.0 * uniform(randomNumGenerator)),
+               1 + (int) (9 * uniform(randomNumGenerator)), uniform(randomNumGenerator), uniform(randomNumGenerator), 1000.0 * uniform(randomNumGenerator));
+    }
+
+    if (outfile != NULL) {
+      *outfile << line;
+    }
+    if (ccl != NULL) {
+      parseCCL(line, line + strlen(line), *ccl);
+    }
+
+  }
+
+}
+
+// Sift a list of candidates exactly as sift and strongSift did before siftEngine.h: go through every remaining candidate for each primary,
+// trying each harmonic ratio, and erase the grouped candidates from the list. The only change is a stable sort, so that candidates with the
+// same S/N are taken in the order they were read, as the engine takes them
+void legacySift(const candidateList &input, harmonicPolicy policy, int maxHarm, double periodMatchFactor, double dmMatchFactor, std::vector<std::vector<double> > &scl) {
+
+  std::vector<std::vector<double> > ccl;
+  std::vector<double> harmRatio;
+  double candPeriod, candDM, testPeriod, testDM, periodRatio = 0.0;
+
+  if (policy == integerHarmonics) {
+    // Integer harmonics from 1 to maxHarm + 3, plus 1/3, 1/2, and 2/3
+    for (int harmonic = 1; harmonic <= maxHarm + 3; harmonic++) {
+      harmRatio.push_back(harmonic);
+    }
+    harmRatio.push_back(1.0/3.0);
+    harmRatio.push_back(1.0/2.0);
+    harmRatio.push_back(2.0/3.0);
+  } else {
+    // Harmonic ratios (1/1, 2/1, 2/2, 3/1, 3/2, ..., 8/7, 8/8), sorted with duplicates removed
+    for (int top = 1; top <= maxHarm; top++) {
+      for (int bottom = 1; bottom <= top; bottom++) {
+        harmRatio.push_back((double) top/bottom);
+      }
+    }
+    std::sort(harmRatio.begin(), harmRatio.end());
+    harmRatio.erase(std::unique(harmRatio.begin(), harmRatio.end()), harmRatio.end());
+  }
+
+  for (size_t cand = 0; cand < input.snr.size(); cand++) {
+    ccl.push_back(std::vector<double>({input.snr[cand], input.period[cand], input.dm[cand]}));
+  }
+  std::stable_sort(ccl.begin(), ccl.end(), [](const std::vector<double> &i, const std::vector<double> &j) { return i[0] > j[0]; });
+
+  scl.clear();
+  while (ccl.size() > 0) {
+
+    // Start with the highest S/N candidate and check to see if any of the other candidates are related
+    candPeriod = ccl[0][1];
+    candDM = ccl[0][2];
+    scl.push_back(ccl[0]);
+
+    for (size_t cand = 1; cand < ccl.size(); cand++) {
+
+      testPeriod = ccl[cand][1];
+      testDM = ccl[cand][2];
+      if (policy == integerHarmonics) {
+        periodRatio = candPeriod/testPeriod;
+      } else if (candPeriod >= testPeriod) {
+        periodRatio = candPeriod/testPeriod;
+      } else {
+        periodRatio = testPeriod/candPeriod;
+      }
+
+      for (auto testHarmRatio = harmRatio.begin(); testHarmRatio != harmRatio.end(); ++testHarmRatio) {
+        bool periodMatch = std::abs(periodRatio - *testHarmRatio) < (periodMatchFactor * *testHarmRatio);
+        if (policy == integerHarmonics) {
+          periodMatch = periodMatch || std::abs((1/periodRatio) - *testHarmRatio) < (periodMatchFactor * *testHarmRatio);
+        }
+        if (periodMatch && std::abs(candDM - testDM) < (candDM * dmMatchFactor)) {
+          scl.back().insert(scl.back().end(), ccl[cand].begin(), ccl[cand].end());
+          ccl[cand].clear();
+          break;
+        }
+      }
+
+    }
+
+    ccl[0].clear();
+    ccl.erase(std::remove(ccl.begin(), ccl.end(), std::vector<double>()), ccl.end());
+
+  }
+
+}
+
+// The groups found by a sift engine, in the same form as legacySift gives them
+void engineGroups(const SiftEngine &engine, std::vector<std::vector<double> > &scl) {
+  scl.clear();
+  for (size_t group = 0; group < engine.groupStarts.size(); group++) {
+    const size_t groupEnd = group + 1 < engine.groupStarts.size() ? engine.groupStarts[group + 1] : engine.scl.size();
+    scl.push_back(std::vector<double>());
+    for (size_t member = engine.groupStarts[group]; member < groupEnd; member++) {
+      scl.back().push_back(engine.ccl.snr[engine.scl[member]]);
+      scl.back().push_back(engine.ccl.period[engine.scl[member]]);
+      scl.back().push_back(engine.ccl.dm[engine.scl[member]]);
+    }
+  }
+}
+
+// Check matchKnownSource against comparing each candidate with every harmonic of every known source, on synthetic sources and candidates:
+// some near harmonics of the sources, including just inside the low edge of the period match (where period/harmonic period is between
+// 1 - f and 1/(1 + f)), and the rest random; returns the number of candidates on which the two disagree
+int checkKnownSources(harmonicPolicy policy, int maxHarm, double periodMatchFactor, double dmMatchFactor, unsigned int seed, size_t &numMatches) {
+
+  std::mt19937_64 randomNumGenerator(seed);
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  KnownSourceIndex known;
+  std::vector<double> periods, DMs;
+  int disagreements = 0;
+
+  for (int source = 0; source < 100; source++) {
+    known.sources.push_back({"PSR" + std::to_string(source), pow(10.0, -2.5 + 3.0 * uniform(randomNumGenerator)), 5.0 + 995.0 * uniform(randomNumGenerator)});
+  }
+  buildKnownSourceIndex(known, getSiftHarmonics(policy, maxHarm, periodMatchFactor), periodMatchFactor, dmMatchFactor);
+
+  const double lowEdgeRatio = periodMatchFactor < 1 ? 0.5 * ((1 - periodMatchFactor) + 1/(1 + periodMatchFactor)) : 0.5;
+  for (const knownHarmonic &harmonic : known.harmonics) {
+    const knownSource &source = known.sources[harmonic.source];
+    const double harmonicPeriod = source.period * harmonic.top/harmonic.bottom;
+    for (double ratio : {lowEdgeRatio, 1.0, 1 + 0.5 * periodMatchFactor, 1 + 2 * periodMatchFactor}) {
+      periods.push_back(harmonicPeriod * ratio);
+      DMs.push_back(source.dm);
+    }
+  }
+  for (size_t cand = 0, numHarmonicCands = periods.size(); cand < numHarmonicCands; cand++) {
+    periods.push_back(pow(10.0, -3.0 + 4.0 * uniform(randomNumGenerator)));
+    DMs.push_back(1000.0 * uniform(randomNumGenerator));
+  }
+
+  numMatches = 0;
+  for (size_t cand = 0; cand < periods.size(); cand++) {
+    double bestDistance = INFINITY;
+    for (const knownHarmonic &harmonic : known.harmonics) {
+      const knownSource &source = known.sources[harmonic.source];
+      const double distance = std::abs(periods[cand]/(source.period * harmonic.top/harmonic.bottom) - 1);
+      if (distance < periodMatchFactor && std::abs(DMs[cand] - source.dm) < source.dm * dmMatchFactor) {
+        bestDistance = std::min(bestDistance, distance);
+      }
+    }
+    const int match = matchKnownSource(known, periods[cand], DMs[cand]);
+    if (match >= 0) {
+      const knownHarmonic &harmonic = known.harmonics[match];
+      numMatches++;
+      disagreements += std::abs(periods[cand]/(known.sources[harmonic.source].period * harmonic.top/harmonic.bottom) - 1) != bestDistance;
+    } else {
+      disagreements += bestDistance != INFINITY;
+    }
+  }
+
+  return disagreements;
+
+}
+
+/* -- siftBench ------------------------------------------------------------------------------------------------------------
+** Checks that siftEngine.h gives exactly the same groups as the algorithm sift and strongSift used to have, and measures how  |
+** both scale with the number of candidates, on synthetic CCLs with known harmonic families. With -g, it only writes such a   |
+** CCL, which sift and strongSift read like any other.                                                                      |
+------------------------------------------------------------------------------------------------------------------------- */
+int main(int argc, char *argv[]) {
+
+  int arg, maxHarm = defaultMaxHarm, familyMaxHarm = 8, numThreads = 0, mismatches = 0;
+  unsigned int seed = 1;
+  long long numCands = 10000, fewestCands = 1000, mostCands = 10000000, legacyLimit = 100000;
+  double familyFraction = 0.5, periodMatchFactor = 0.001, dmMatchFactor = 0.1;
+  const char *outFileName = NULL;
+  std::vector<harmonicPolicy> policies = {integerHarmonics, allHarmonics};
+
+  // Read command line parameters
+  while ((arg = getopt(argc, argv, "a:A:d:F:g:hH:j:L:m:n:p:s:t:")) != -1) {
+    switch (arg) {
+
+      case 'a':
+        fewestCands = atoll(optarg);
+        break;
+
+      case 'A':
+        mostCands = atoll(optarg);
+        break;
+
+      case 'd':
+        dmMatchFactor = atof(optarg);
+        break;
+
+      case 'F':
+        familyFraction = atof(optarg);
+        break;
+
+      case 'g':
+        outFileName = optarg;
+        break;
+
+      case 'H':
+        maxHarm = atoi(optarg);
+        break;
+
+      case 'j':
+        numThreads = atoi(optarg);
+        break;
+
+      case 'L':
+        legacyLimit = atoll(optarg);
+        break;
+
+      case 'm':
+        familyMaxHarm = atoi(optarg);
+        break;
+
+      case 'n':
+        numCands = atoll(optarg);
+        break;
+
+      case 'p':
+        periodMatchFactor = atof(optarg);
+        break;
+
+      case 's':
+        seed = atoi(optarg);
+        break;
+
+      case 't':
+        if (strcmp(optarg, "sift") == 0) {
+          policies = {integerHarmonics};
+        } else if (strcmp(optarg, "strongSift") == 0) {
+          policies = {allHarmonics};
+        } else if (strcmp(optarg, "both") != 0) {
+          std::cerr << "Unknown tool " << optarg << "; it must be sift, strongSift, or both!" << std::endl;
+          exit(0);
+        }
+        break;
+
+      case 'h':
+        usage();
+        exit(0);
+
+      default:
+        return 0;
+        break;
+
+    }
+  }
+
+  if (familyFraction < 0.0 || familyFraction > 1.0 || maxHarm < 1 || familyMaxHarm < 1 || fewestCands < 1) {
+    std::cerr << "-F must be between 0 and 1, and -H, -m, and -a must be at least 1!" << std::endl;
+    exit(0);
+  }
+
+  // Only write a synthetic CCL
+  if (outFileName != NULL) {
+    std::ofstream outfile(outFileName);
+    if (!outfile.is_open()) {
+      std::cerr << "Error opening file " << outFileName << " for writing!" << std::endl;
+      exit(0);
+    }
+    generateCCL(numCands, familyFraction, familyMaxHarm, seed, &outfile, NULL);
+    std::cout << "Wrote " << numCands << " candidates to " << outFileName << std::endl;
+    return 0;
+  }
+
+  std::cout << "Sifting synthetic CCLs with " << familyFraction * 100 << "% of candidates in harmonic families, -p " << periodMatchFactor << " -d " << dmMatchFactor << " -H " << maxHarm << std::endl;
+  std::cout << "      tool  candidates      groups   legacy (s)   engine (s)   speedup  groups match" << std::endl;
+
+  for (long long size = fewestCands; size <= mostCands; size *= 10) {
+
+    candidateList ccl;
+    generateCCL(size, familyFraction, familyMaxHarm, seed, NULL, &ccl);
+
+    for (harmonicPolicy policy : policies) {
+
+      std::vector<std::vector<double> > legacySCL, engineSCL;
+      SiftEngine engine;
+      double legacyTime = -1.0;
+
+      if (size <= legacyLimit) {
+        auto start = std::chrono::steady_clock::now();
+        legacySift(ccl, policy, maxHarm, periodMatchFactor, dmMatchFactor, legacySCL);
+        legacyTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      }
+
+      auto start = std::chrono::steady_clock::now();
+      setupSiftEngine(engine, policy, maxHarm, periodMatchFactor, dmMatchFactor, numThreads);
+      siftCandidates(engine, ccl);
+      const double engineTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      engineGroups(engine, engineSCL);
+
+      char row[160];
+      if (legacyTime >= 0.0) {
+        const bool match = legacySCL == engineSCL;
+        mismatches += !match;
+        snprintf(row, sizeof(row), "%10s %11lld %11zu %12.3f %12.3f %9.1f  %s", policy == integerHarmonics ? "sift" : "strongSift", size, engineSCL.size(), legacyTime, engineTime, legacyTime/engineTime, match ? "yes" : "NO");
+      } else {
+        snprintf(row, sizeof(row), "%10s %11lld %11zu %12s %12.3f %9s  %s", policy == integerHarmonics ? "sift" : "strongSift", size, engineSCL.size(), "-", engineTime, "-", "-");
+      }
+      std::cout << row << std::endl;
+
+    }
+
+  }
+
+  // Check that matching known sources finds the same harmonics as comparing with every one
+  for (harmonicPolicy policy : policies) {
+    size_t numMatches;
+    const int disagreements = checkKnownSources(policy, maxHarm, periodMatchFactor, dmMatchFactor, seed, numMatches);
+    std::cout << (policy == integerHarmonics ? "sift" : "strongSift") << " known sources: " << numMatches << " candidates matched, " << disagreements << " different from comparing every harmonic" << std::endl;
+    mismatches += disagreements > 0;
+  }
+
+  if (mismatches > 0) {
+    std::cout << mismatches << " run(s) gave different groups or known source matches!" << std::endl;
+    return 1;
+  }
+
+  return 0;
+
+}
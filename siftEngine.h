@@ -0,0 +1,992 @@
+#ifndef SIFTENGINE_H
+#define SIFTENGINE_H
+
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <cstdint>
+#include <cctype>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <charconv>
+#include <algorithm>
+#include <vector>
+#include <map>
+#include <queue>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <getopt.h>
+#include <atomic>
+#include <thread>
+
+/* -- siftEngine ----------------------------------------------------------------------------------------------------
+** The sifting shared by sift and strongSift, which only differ in the harmonic ratios they try and in how a ratio of  |
+** periods is compared with them (the harmonic policy).                                                              |
+**                                                                                                                   |
+** integerHarmonics (sift): integer ratios, plus 1/3, 1/2, and 2/3. Both candPeriod/testPeriod and its inverse are    |
+** compared with each ratio. For historical reasons the integer ratios go up to maxHarm + 3.                          |
+** allHarmonics (strongSift): every top/bottom with 1 <= bottom <= top <= maxHarm. The larger period over the smaller  |
+** is compared with each ratio.                                                                                      |
+**                                                                                                                   |
+** Ratios are kept as reduced, sorted, unique fractions, so e.g. 2/2, 3/3, and 4/4 are one ratio. The tables for the  |
+** default maxHarm of 8 are built at compile time. Candidates are sifted greedily in order of S/N, as the tools always |
+** have, using a period-sorted index and batches of primaries shared between threads (see siftCandidates).           |
+------------------------------------------------------------------------------------------------------------------- */
+
+enum harmonicPolicy {integerHarmonics, allHarmonics};
+
+struct harmonicRatio {
+  int top, bottom;
+};
+
+// A harmonic ratio with its period match window, for a given period match factor
+struct siftHarmonic {
+  double ratio, tolerance, lowRatio, highRatio;
+  int top, bottom;
+};
+
+template <int capacity>
+struct harmonicTable {
+  harmonicRatio ratios[capacity];
+  int size;
+};
+
+// The most ratios a policy can produce before duplicates are removed
+constexpr int harmonicTableCapacity(harmonicPolicy policy, int maxHarm) {
+  return policy == integerHarmonics ? maxHarm + 6 : maxHarm * (maxHarm + 1)/2;
+}
+
+constexpr int greatestCommonDivisor(int a, int b) {
+  while (b != 0) {
+    int remainder = a % b;
+    a = b;
+    b = remainder;
+  }
+  return a;
+}
+
+// Add top/bottom, reduced, to a sorted table of unique ratios holding 'size' entries, keeping it sorted; returns the new size
+constexpr int addHarmonicRatio(harmonicRatio *ratios, int size, int top, int bottom) {
+  const int divisor = greatestCommonDivisor(top, bottom);
+  top /= divisor;
+  bottom /= divisor;
+  // Fractions are compared by cross-multiplying, so no rounding is involved
+  int position = 0;
+  while (position < size && (long long) ratios[position].top * bottom < (long long) top * ratios[position].bottom) {
+    position++;
+  }
+  if (position < size && ratios[position].top == top && ratios[position].bottom == bottom) {
+    return size;
+  }
+  for (int i = size; i > position; i--) {
+    ratios[i] = ratios[i - 1];
+  }
+  ratios[position] = {top, bottom};
+  return size + 1;
+}
+
+// Fill a table (with room for harmonicTableCapacity(policy, maxHarm) ratios) with the ratios of a policy; returns the number of ratios
+constexpr int fillHarmonicTable(harmonicPolicy policy, int maxHarm, harmonicRatio *ratios) {
+  int size = 0;
+  if (policy == integerHarmonics) {
+    for (int harmonic = 1; harmonic <= maxHarm + 3; harmonic++) {
+      size = addHarmonicRatio(ratios, size, harmonic, 1);
+    }
+    size = addHarmonicRatio(ratios, size, 1, 3);
+    size = addHarmonicRatio(ratios, size, 1, 2);
+    size = addHarmonicRatio(ratios, size, 2, 3);
+  } else {
+    for (int top = 1; top <= maxHarm; top++) {
+      for (int bottom = 1; bottom <= top; bottom++) {
+        size = addHarmonicRatio(ratios, size, top, bottom);
+      }
+    }
+  }
+  return size;
+}
+
+template <harmonicPolicy policy, int maxHarm>
+constexpr harmonicTable<harmonicTableCapacity(policy, maxHarm)> makeHarmonicTable() {
+  harmonicTable<harmonicTableCapacity(policy, maxHarm)> table{};
+  table.size = fillHarmonicTable(policy, maxHarm, table.ratios);
+  return table;
+}
+
+// The tables for the default maxHarm, built by the compiler
+const int defaultMaxHarm = 8;
+constexpr auto defaultIntegerHarmonics = makeHarmonicTable<integerHarmonics, defaultMaxHarm>();
+constexpr auto defaultAllHarmonics = makeHarmonicTable<allHarmonics, defaultMaxHarm>();
+static_assert(defaultIntegerHarmonics.size == 14, "sift tries 1 to 11, 1/3, 1/2, and 2/3 by default");
+static_assert(defaultAllHarmonics.size == 22, "strongSift tries 22 unique ratios top/bottom with top <= 8 by default");
+
+// The harmonic ratios of a policy with their match windows, in increasing order
+inline std::vector<siftHarmonic> getSiftHarmonics(harmonicPolicy policy, int maxHarm, double periodMatchFactor) {
+
+  std::vector<harmonicRatio> ratios;
+  std::vector<siftHarmonic> harmonics;
+
+  if (maxHarm == defaultMaxHarm) {
+    const harmonicRatio *table = policy == integerHarmonics ? defaultIntegerHarmonics.ratios : defaultAllHarmonics.ratios;
+    ratios.assign(table, table + (policy == integerHarmonics ? defaultIntegerHarmonics.size : defaultAllHarmonics.size));
+  } else {
+    ratios.resize(harmonicTableCapacity(policy, maxHarm));
+    ratios.resize(fillHarmonicTable(policy, maxHarm, &ratios[0]));
+  }
+
+  for (const harmonicRatio &ratio : ratios) {
+    siftHarmonic harmonic;
+    harmonic.ratio = (double) ratio.top/ratio.bottom;
+    harmonic.tolerance = periodMatchFactor * harmonic.ratio;
+    harmonic.lowRatio = harmonic.ratio * (1 - periodMatchFactor);
+    harmonic.highRatio = harmonic.ratio * (1 + periodMatchFactor);
+    harmonic.top = ratio.top;
+    harmonic.bottom = ratio.bottom;
+    harmonics.push_back(harmonic);
+  }
+
+  return harmonics;
+
+}
+
+// Whether testPeriod is the given harmonic of candPeriod, as the policy compares them
+inline bool isHarmonic(harmonicPolicy policy, double candPeriod, double testPeriod, const siftHarmonic &harmonic) {
+  if (policy == integerHarmonics) {
+    // Both the ratio of the periods and its inverse are tested against the harmonic
+    const double periodRatio = candPeriod/testPeriod;
+    return std::abs(periodRatio - harmonic.ratio) < harmonic.tolerance || std::abs((1/periodRatio) - harmonic.ratio) < harmonic.tolerance;
+  } else {
+    // Since all of the ratios are at least one, use the larger period over the smaller
+    const double periodRatio = candPeriod >= testPeriod ? candPeriod/testPeriod : testPeriod/candPeriod;
+    return std::abs(periodRatio - harmonic.ratio) < harmonic.tolerance;
+  }
+}
+
+// Candidates as a flat table with one array per parameter. The name 'ccl' stands for 'Crude Candidate List'
+struct candidateList {
+  std::vector<double> snr, period, dm;
+};
+
+// Find the next whitespace-separated token at or after 'position', returning its start and setting 'tokenEnd' to just past it, or returning 'end' if there are none
+inline const char *nextCCLToken(const char *position, const char *end, const char *&tokenEnd) {
+  while (position < end && isspace((unsigned char) *position)) {
+    position++;
+  }
+  tokenEnd = position;
+  while (tokenEnd < end && !isspace((unsigned char) *tokenEnd)) {
+    tokenEnd++;
+  }
+  return position;
+}
+
+// Parse candidates from the text of a CCL file, appending them to 'ccl': S/N, period(error), two unused columns, and DM for each candidate
+// The period is read up to the parenthesis holding its error, so nothing needs to be copied or allocated. Parsing stops at the first
+// candidate that can't be read, as reading with the standard streams would
+inline void parseCCL(const char *position, const char *end, candidateList &ccl) {
+
+  const char *tokenEnd;
+  double peakSNR, period, dm;
+
+  // Make room for as many candidates as there are lines, so the columns are only allocated once for a whole file
+  // When the text is short (a line at a time), the columns grow by at least doubling, so appending many pieces stays linear
+  const size_t numLines = std::count(position, end, '\n') + 1;
+  if (ccl.snr.capacity() < ccl.snr.size() + numLines) {
+    const size_t capacity = std::max(ccl.snr.size() + numLines, 2 * ccl.snr.capacity());
+    ccl.snr.reserve(capacity);
+    ccl.period.reserve(capacity);
+    ccl.dm.reserve(capacity);
+  }
+
+  while (true) {
+
+    position = nextCCLToken(position, end, tokenEnd);
+    if (position == end || std::from_chars(position, tokenEnd, peakSNR).ec != std::errc()) {
+      break;
+    }
+
+    // The period has an error listed in parentheses, which from_chars stops at
+    position = nextCCLToken(tokenEnd, end, tokenEnd);
+    const std::from_chars_result periodResult = std::from_chars(position, tokenEnd, period);
+    if (position == end || periodResult.ec != std::errc() || (periodResult.ptr != tokenEnd && *periodResult.ptr != '(')) {
+      break;
+    }
+
+    // Skip the two unused columns
+    position = nextCCLToken(tokenEnd, end, tokenEnd);
+    position = nextCCLToken(tokenEnd, end, tokenEnd);
+
+    position = nextCCLToken(tokenEnd, end, tokenEnd);
+    if (position == end || std::from_chars(position, tokenEnd, dm).ec != std::errc()) {
+      break;
+    }
+    position = tokenEnd;
+
+    ccl.snr.push_back(peakSNR);
+    ccl.period.push_back(period);
+    ccl.dm.push_back(dm);
+
+  }
+
+}
+
+// Read every candidate in a CCL file, mapping the file into memory and parsing it in place
+// Returns 1 on success, 0 if the file can't be read
+inline int readCCLFile(const char *fileName, candidateList &ccl) {
+
+  struct stat fileStatus;
+  int fileDescriptor = open(fileName, O_RDONLY);
+
+  if (fileDescriptor < 0) {
+    return 0;
+  }
+
+  if (fstat(fileDescriptor, &fileStatus) != 0) {
+    close(fileDescriptor);
+    return 0;
+  }
+  const size_t fileSize = fileStatus.st_size;
+  if (fileSize > 0) {
+    void *mappedFile = mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+    if (mappedFile == MAP_FAILED) {
+      close(fileDescriptor);
+      return 0;
+    }
+    madvise(mappedFile, fileSize, MADV_SEQUENTIAL);
+    parseCCL((const char*) mappedFile, (const char*) mappedFile + fileSize, ccl);
+    munmap(mappedFile, fileSize);
+  }
+  close(fileDescriptor);
+
+  return 1;
+
+}
+
+// Read the candidates in several CCL files into one list, in the order the files are given, reading up to 'numThreads' files at once
+// Returns the index of the first file that can't be read, or -1 if they were all read
+inline int readCCLFiles(const std::vector<const char*> &fileNames, candidateList &ccl, int numThreads) {
+
+  std::vector<candidateList> fileCandidates(fileNames.size());
+  std::vector<int> fileRead(fileNames.size(), 0);
+
+  // Share the files out between the threads
+  std::atomic<size_t> nextItem(0);
+  std::vector<std::thread> threads;
+  const int numReaders = std::max(1, std::min(numThreads, (int) fileNames.size()));
+  for (int thread = 0; thread < numReaders; thread++) {
+    threads.push_back(std::thread([&]() {
+      for (size_t item = nextItem++; item < fileNames.size(); item = nextItem++) {
+        fileRead[item] = readCCLFile(fileNames[item], fileCandidates[item]);
+      }
+    }));
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  // Put the files' candidates together
+  size_t numCands = ccl.snr.size();
+  for (size_t file = 0; file < fileNames.size(); file++) {
+    if (!fileRead[file]) {
+      return file;
+    }
+    numCands += fileCandidates[file].snr.size();
+  }
+  ccl.snr.reserve(numCands);
+  ccl.period.reserve(numCands);
+  ccl.dm.reserve(numCands);
+  for (const candidateList &candidates : fileCandidates) {
+    ccl.snr.insert(ccl.snr.end(), candidates.snr.begin(), candidates.snr.end());
+    ccl.period.insert(ccl.period.end(), candidates.period.begin(), candidates.period.end());
+    ccl.dm.insert(ccl.dm.end(), candidates.dm.begin(), candidates.dm.end());
+  }
+
+  return -1;
+
+}
+
+// Relative amount by which the period windows searched for harmonics are widened, so rounding in the ratios can't leave out a candidate that would match
+const double siftWindowMargin = 1e-9;
+
+/* -- Known sources ------------------------------------------------------------------------------------------------
+** Candidates that are harmonics of known pulsars in the field can be taken out (or just listed) before sifting. The   |
+** catalog is a text file with the name, period (in the same units as the CCL), and DM of a source on each line; lines |
+** starting with '#' are skipped. Every harmonic of every source, for each ratio the harmonic policy tries and its     |
+** inverse, goes in one index sorted by log period, so matching a candidate is a binary search: O(n log m) for n       |
+** candidates and m harmonics.                                                                                       |
+------------------------------------------------------------------------------------------------------------------- */
+
+struct knownSource {
+  std::string name;
+  double period, dm;
+};
+
+// A harmonic of a known source, with period = source period * top/bottom
+struct knownHarmonic {
+  double logPeriod;
+  int source, top, bottom;
+};
+
+struct KnownSourceIndex {
+  std::vector<knownSource> sources;
+  std::vector<knownHarmonic> harmonics;
+  double periodMatchFactor, dmMatchFactor;
+};
+
+// Read a catalog of known sources; returns 1 on success, 0 if the file can't be read or a line can't be understood
+inline int readKnownSources(const char *fileName, KnownSourceIndex &known) {
+
+  std::ifstream file(fileName);
+  std::string line;
+  knownSource source;
+
+  if (!file.is_open()) {
+    return 0;
+  }
+  while (std::getline(file, line)) {
+    std::istringstream fields(line);
+    std::string first;
+    if (!(fields >> first) || first[0] == '#') {
+      continue;
+    }
+    source.name = first;
+    if (!(fields >> source.period >> source.dm) || source.period <= 0) {
+      return 0;
+    }
+    known.sources.push_back(source);
+  }
+
+  return 1;
+
+}
+
+// Index every harmonic of the known sources: each ratio of the harmonic policy and its inverse
+inline void buildKnownSourceIndex(KnownSourceIndex &known, const std::vector<siftHarmonic> &harmonics, double periodMatchFactor, double dmMatchFactor) {
+  known.periodMatchFactor = periodMatchFactor;
+  known.dmMatchFactor = dmMatchFactor;
+  known.harmonics.clear();
+  for (size_t source = 0; source < known.sources.size(); source++) {
+    for (const siftHarmonic &harmonic : harmonics) {
+      known.harmonics.push_back({log(known.sources[source].period * harmonic.top/harmonic.bottom), (int) source, harmonic.top, harmonic.bottom});
+      if (harmonic.top != harmonic.bottom) {
+        known.harmonics.push_back({log(known.sources[source].period * harmonic.bottom/harmonic.top), (int) source, harmonic.bottom, harmonic.top});
+      }
+    }
+  }
+  std::sort(known.harmonics.begin(), known.harmonics.end(), [](const knownHarmonic &a, const knownHarmonic &b) { return a.logPeriod < b.logPeriod; });
+  // A ratio and its inverse can be the same harmonic (1/3 and 3 for sift), so remove repeats of the same harmonic of a source
+  known.harmonics.erase(std::unique(known.harmonics.begin(), known.harmonics.end(), [](const knownHarmonic &a, const knownHarmonic &b) {
+    return a.source == b.source && (long long) a.top * b.bottom == (long long) b.top * a.bottom;
+  }), known.harmonics.end());
+}
+
+// Find the harmonic of a known source closest in period to a candidate that is within the period and DM match factors of it, or -1 if there isn't one
+inline int matchKnownSource(const KnownSourceIndex &known, double period, double dm) {
+
+  // |period/harmonic period - 1| < f means the harmonic period is between period/(1 + f) and period/(1 - f), which isn't symmetric in log period
+  const double logPeriod = log(period), factor = known.periodMatchFactor;
+  const double logLow = logPeriod - log1p(factor) * (1 + siftWindowMargin);
+  const double logHigh = factor < 1 ? logPeriod - log1p(-factor) * (1 + siftWindowMargin) : INFINITY;
+  int bestMatch = -1;
+  double bestDistance = INFINITY;
+
+  for (auto harmonic = std::lower_bound(known.harmonics.begin(), known.harmonics.end(), logLow, [](const knownHarmonic &a, double value) { return a.logPeriod < value; });
+       harmonic != known.harmonics.end() && harmonic->logPeriod <= logHigh; ++harmonic) {
+    const knownSource &source = known.sources[harmonic->source];
+    const double harmonicPeriod = source.period * harmonic->top/harmonic->bottom;
+    const double distance = std::abs(period/harmonicPeriod - 1);
+    if (distance < known.periodMatchFactor && std::abs(dm - source.dm) < source.dm * known.dmMatchFactor && distance < bestDistance) {
+      bestMatch = harmonic - known.harmonics.begin();
+      bestDistance = distance;
+    }
+  }
+
+  return bestMatch;
+
+}
+
+// List the candidates that match known sources, as their S/N, period, DM, source name, and harmonic (candidate period/source period), and
+// take them out of the list if 'drop' is set; returns the number of matches
+inline size_t filterKnownSources(const KnownSourceIndex &known, candidateList &ccl, bool drop, std::ostream &knownFile) {
+
+  size_t kept = 0, numMatches = 0;
+
+  for (size_t cand = 0; cand < ccl.snr.size(); cand++) {
+    const int match = matchKnownSource(known, ccl.period[cand], ccl.dm[cand]);
+    if (match >= 0) {
+      const knownHarmonic &harmonic = known.harmonics[match];
+      knownFile << ccl.snr[cand] << " " << ccl.period[cand] << " " << ccl.dm[cand] << " " << known.sources[harmonic.source].name << " " << harmonic.top << "/" << harmonic.bottom << "\n";
+      numMatches++;
+      if (drop) {
+        continue;
+      }
+    }
+    ccl.snr[kept] = ccl.snr[cand];
+    ccl.period[kept] = ccl.period[cand];
+    ccl.dm[kept] = ccl.dm[cand];
+    kept++;
+  }
+  ccl.snr.resize(kept);
+  ccl.period.resize(kept);
+  ccl.dm.resize(kept);
+
+  return numMatches;
+
+}
+
+struct SiftEngine {
+  harmonicPolicy policy;
+  double dmMatchFactor;
+  int numThreads;
+  std::vector<siftHarmonic> harmonics;
+  // The candidates, in S/N order
+  candidateList ccl;
+  // One bit per candidate, set while the candidate has not yet been put in the SCL or grouped with a candidate that has
+  std::vector<uint64_t> alive;
+  // The candidates in order of period, with their periods, so the candidates with periods in a given range can be found with a binary search
+  std::vector<int> byPeriod;
+  std::vector<double> sortedPeriods;
+  // Group membership of the sifted candidates, in one array: the members of each group follow its primary candidate
+  // The name 'scl' stands for 'Sifted Candidate List'
+  std::vector<int> scl;
+  std::vector<size_t> groupStarts;
+};
+
+inline void setupSiftEngine(SiftEngine &engine, harmonicPolicy policy, int maxHarm, double periodMatchFactor, double dmMatchFactor, int numThreads) {
+  engine.policy = policy;
+  engine.dmMatchFactor = dmMatchFactor;
+  engine.numThreads = numThreads < 1 ? std::max(1u, std::thread::hardware_concurrency()) : numThreads;
+  engine.harmonics = getSiftHarmonics(policy, maxHarm, periodMatchFactor);
+}
+
+inline bool isAlive(const SiftEngine &engine, int cand) {
+  return (engine.alive[cand/64] >> (cand % 64)) & 1;
+}
+
+inline void removeCandidate(SiftEngine &engine, int cand) {
+  engine.alive[cand/64] &= ~(((uint64_t) 1) << (cand % 64));
+}
+
+// Find the first candidate still alive at or after 'cand', or the number of candidates if there are none, skipping 64 at a time over candidates that have been dealt with
+inline int nextAlive(const SiftEngine &engine, int cand) {
+  const int numCands = engine.ccl.snr.size();
+  size_t word = cand/64;
+  if (word >= engine.alive.size()) {
+    return numCands;
+  }
+  uint64_t bits = engine.alive[word] & (~((uint64_t) 0) << (cand % 64));
+  while (bits == 0) {
+    if (++word == engine.alive.size()) {
+      return numCands;
+    }
+    bits = engine.alive[word];
+  }
+  return (int) (word * 64 + __builtin_ctzll(bits));
+}
+
+// The periods for which period/testPeriod, and for which testPeriod/period, are within the period match factor of a harmonic ratio
+// The windows are the same whichever of the two periods is given, so they also hold every period that 'period' could be a harmonic of
+inline void getHarmonicWindows(const siftHarmonic &harmonic, double period, double windows[2][2]) {
+  windows[0][0] = period/harmonic.highRatio * (1 - siftWindowMargin);
+  windows[0][1] = harmonic.lowRatio > 0 ? period/harmonic.lowRatio * (1 + siftWindowMargin) : INFINITY;
+  windows[1][0] = harmonic.lowRatio > 0 ? period * harmonic.lowRatio * (1 - siftWindowMargin) : -INFINITY;
+  windows[1][1] = period * harmonic.highRatio * (1 + siftWindowMargin);
+}
+
+// Find the candidates still in the list that are related to candidate 'primary', in S/N order, without changing the list
+// For each harmonic ratio, only the candidates with periods that could be that harmonic (or subharmonic) of the candidate's period are looked at
+inline void findRelated(const SiftEngine &engine, int primary, std::vector<int> &matches) {
+
+  const double candPeriod = engine.ccl.period[primary], candDM = engine.ccl.dm[primary];
+
+  matches.clear();
+  for (const siftHarmonic &harmonic : engine.harmonics) {
+
+    double windows[2][2];
+    getHarmonicWindows(harmonic, candPeriod, windows);
+
+    for (int window = 0; window < 2; window++) {
+      for (size_t position = std::lower_bound(engine.sortedPeriods.begin(), engine.sortedPeriods.end(), windows[window][0]) - engine.sortedPeriods.begin(); position < engine.sortedPeriods.size() && engine.sortedPeriods[position] <= windows[window][1]; position++) {
+        const int cand = engine.byPeriod[position];
+        // If the periods are harmonically related and the DMs are close enough, this signal is a harmonic of the candidate
+        if (cand != primary && isAlive(engine, cand) && isHarmonic(engine.policy, candPeriod, engine.ccl.period[cand], harmonic) && std::abs(candDM - engine.ccl.dm[cand]) < (candDM * engine.dmMatchFactor)) {
+          matches.push_back(cand);
+        }
+      }
+    }
+
+  }
+
+  // A candidate can be in more than one window, so sort and remove duplicates
+  std::sort(matches.begin(), matches.end());
+  matches.erase(std::unique(matches.begin(), matches.end()), matches.end());
+
+}
+
+// Sift a list of candidates: sort them by S/N, then repeatedly take the highest S/N candidate left, group every remaining candidate related to it
+// with it, and remove the group from the list. The groups are left in engine.scl and engine.groupStarts
+inline void siftCandidates(SiftEngine &engine, const candidateList &input) {
+
+  const int numCands = input.snr.size();
+  int cand, primary;
+
+  // Sort the candidates by S/N, from highest to lowest; candidates with the same S/N stay in the order they were read, so the result doesn't depend on the sort
+  std::vector<int> order(numCands);
+  for (cand = 0; cand < numCands; cand++) {
+    order[cand] = cand;
+  }
+  std::stable_sort(order.begin(), order.end(), [&input](int i, int j) { return input.snr[i] > input.snr[j]; });
+  engine.ccl.snr.resize(numCands);
+  engine.ccl.period.resize(numCands);
+  engine.ccl.dm.resize(numCands);
+  for (cand = 0; cand < numCands; cand++) {
+    engine.ccl.snr[cand] = input.snr[order[cand]];
+    engine.ccl.period[cand] = input.period[order[cand]];
+    engine.ccl.dm[cand] = input.dm[order[cand]];
+  }
+
+  // Every candidate starts in the list; candidates are never moved once they are dealt with, their bits are just cleared
+  engine.alive.assign((numCands + 63)/64, ~((uint64_t) 0));
+  if (numCands % 64 != 0) {
+    engine.alive.back() = (((uint64_t) 1) << (numCands % 64)) - 1;
+  }
+
+  // Index the candidates by period
+  engine.byPeriod.resize(numCands);
+  engine.sortedPeriods.resize(numCands);
+  for (cand = 0; cand < numCands; cand++) {
+    engine.byPeriod[cand] = cand;
+  }
+  std::sort(engine.byPeriod.begin(), engine.byPeriod.end(), [&engine](int i, int j) { return engine.ccl.period[i] < engine.ccl.period[j] || (engine.ccl.period[i] == engine.ccl.period[j] && i < j); });
+  for (cand = 0; cand < numCands; cand++) {
+    engine.sortedPeriods[cand] = engine.ccl.period[engine.byPeriod[cand]];
+  }
+
+  engine.scl.clear();
+  engine.scl.reserve(numCands);
+  engine.groupStarts.clear();
+
+  // Candidates are taken as primaries in batches of the next live candidates in S/N order. The related candidates of every primary in a batch are
+  // found in parallel, as if none of the batch had been grouped yet. Then the batch is gone through in S/N order just as one thread would go through
+  // the list: a primary that was grouped with an earlier one in the batch is skipped, and related candidates that have already been grouped are left
+  // out. Grouping only ever removes candidates from the list, so the groups are exactly the same as sifting one primary at a time
+  const int batchSize = engine.numThreads == 1 ? 1 : 16 * engine.numThreads;
+  std::vector<int> batch;
+  std::vector<std::vector<int> > batchRelated(batchSize);
+
+  // Loop until all candidates have been dealt with
+  primary = nextAlive(engine, 0);
+  while (primary < numCands) {
+
+    // The next batch of primaries
+    batch.clear();
+    for (cand = primary; cand < numCands && (int) batch.size() < batchSize; cand = nextAlive(engine, cand + 1)) {
+      batch.push_back(cand);
+    }
+
+    // Find their related candidates, sharing the primaries out between the threads
+    if (engine.numThreads == 1) {
+      findRelated(engine, batch[0], batchRelated[0]);
+    } else {
+      std::atomic<size_t> nextItem(0);
+      std::vector<std::thread> threads;
+      for (int thread = 0; thread < engine.numThreads; thread++) {
+        threads.push_back(std::thread([&]() {
+          for (size_t item = nextItem++; item < batch.size(); item = nextItem++) {
+            findRelated(engine, batch[item], batchRelated[item]);
+          }
+        }));
+      }
+      for (auto &thread : threads) {
+        thread.join();
+      }
+    }
+
+    for (size_t item = 0; item < batch.size(); item++) {
+
+      // Skip primaries that are harmonics of an earlier one
+      primary = batch[item];
+      if (!isAlive(engine, primary)) {
+        continue;
+      }
+
+      // Put this candidate in the sifted candidate list
+      removeCandidate(engine, primary);
+      engine.groupStarts.push_back(engine.scl.size());
+      engine.scl.push_back(primary);
+
+      // Add its harmonics that are still in the list to its group, in S/N order, and remove them from the list
+      for (int related : batchRelated[item]) {
+        if (isAlive(engine, related)) {
+          engine.scl.push_back(related);
+          removeCandidate(engine, related);
+        }
+      }
+
+    }
+
+    primary = nextAlive(engine, batch.back() + 1);
+
+  }
+
+}
+
+// Write the candidates of one group (the signal and all of its harmonics), in order, without ending the line
+inline void writeSCLGroup(std::ostream &outfile, const candidateList &ccl, const int *firstMember, const int *lastMember) {
+  for (const int *member = firstMember; member < lastMember; member++) {
+    outfile << ccl.snr[*member] << " " << ccl.period[*member] << " " << ccl.dm[*member] << " ";
+  }
+}
+
+// Write each group to one line
+inline void writeSCL(const SiftEngine &engine, std::ostream &outfile) {
+  for (size_t group = 0; group < engine.groupStarts.size(); group++) {
+    const size_t groupEnd = group + 1 < engine.groupStarts.size() ? engine.groupStarts[group + 1] : engine.scl.size();
+    writeSCLGroup(outfile, engine.ccl, &engine.scl[0] + engine.groupStarts[group], &engine.scl[0] + groupEnd);
+    outfile << "\n";
+  }
+}
+
+/* -- Incremental sifting --------------------------------------------------------------------------------------------
+** Candidates that arrive one at a time are added to the groups without sifting everything again. The groups are kept  |
+** exactly as sifting all of the candidates so far at once would leave them: each candidate belongs to the highest S/N |
+** primary it is a harmonic of, or starts its own group if there is none.                                              |
+**                                                                                                                     |
+** A new candidate joins the highest S/N group whose primary it is a harmonic of, if that primary outranks it. If not,  |
+** it becomes a primary, and any group with a lower S/N primary that holds one of its harmonics is broken up; its      |
+** members are then placed again in the same way, highest S/N first, which can break up further groups. Only those     |
+** groups are touched, and each change is reported as a line of a diff of the SCL:                                     |
+**   + id group     a new group                                                                                        |
+**   ~ id group     a group whose members have changed                                                                 |
+**   - id           a group that is gone                                                                               |
+** where the group is written as a line of scl.txt is. Group ids are never reused.                                     |
+--------------------------------------------------------------------------------------------------------------------- */
+
+struct siftGroup {
+  std::vector<int> members;
+  bool alive;
+};
+
+struct IncrementalSift {
+  harmonicPolicy policy;
+  double dmMatchFactor;
+  std::vector<siftHarmonic> harmonics;
+  // Every candidate so far, in the order they arrived, with the group each belongs to
+  candidateList ccl;
+  std::vector<int> groupOf;
+  // Groups are numbered in the order they were made; the members of each are in order of S/N
+  std::vector<siftGroup> groups;
+  // Every candidate, and the primary candidate of every live group, by period
+  std::multimap<double, int> byPeriod, primariesByPeriod;
+};
+
+// Whether candidate i comes before candidate j in the order the candidates are sifted: higher S/N first, then earlier arrival
+inline bool outranks(const IncrementalSift &sifter, int i, int j) {
+  return sifter.ccl.snr[i] > sifter.ccl.snr[j] || (sifter.ccl.snr[i] == sifter.ccl.snr[j] && i < j);
+}
+
+// Whether testCand is a harmonic of primary, and close enough to it in DM, to be grouped with it
+inline bool isRelated(const IncrementalSift &sifter, int primary, int testCand, const siftHarmonic &harmonic) {
+  return isHarmonic(sifter.policy, sifter.ccl.period[primary], sifter.ccl.period[testCand], harmonic) && std::abs(sifter.ccl.dm[primary] - sifter.ccl.dm[testCand]) < (sifter.ccl.dm[primary] * sifter.dmMatchFactor);
+}
+
+// Find the candidates in 'index' that 'cand' is related to (asPrimary = false), or that are related to 'cand' (asPrimary = true), in no particular order
+inline void findIndexedRelated(const IncrementalSift &sifter, const std::multimap<double, int> &index, int cand, bool asPrimary, std::vector<int> &matches) {
+  double windows[2][2];
+  matches.clear();
+  for (const siftHarmonic &harmonic : sifter.harmonics) {
+    getHarmonicWindows(harmonic, sifter.ccl.period[cand], windows);
+    for (int window = 0; window < 2; window++) {
+      for (auto entry = index.lower_bound(windows[window][0]); entry != index.end() && entry->first <= windows[window][1]; ++entry) {
+        if (entry->second != cand && (asPrimary ? isRelated(sifter, cand, entry->second, harmonic) : isRelated(sifter, entry->second, cand, harmonic))) {
+          matches.push_back(entry->second);
+        }
+      }
+    }
+  }
+}
+
+inline void removePrimary(IncrementalSift &sifter, int primary) {
+  auto range = sifter.primariesByPeriod.equal_range(sifter.ccl.period[primary]);
+  for (auto entry = range.first; entry != range.second; ++entry) {
+    if (entry->second == primary) {
+      sifter.primariesByPeriod.erase(entry);
+      return;
+    }
+  }
+}
+
+// Start incremental sifting from the result of sifting a list of candidates with an engine
+inline void setupIncrementalSift(IncrementalSift &sifter, const SiftEngine &engine) {
+  sifter.policy = engine.policy;
+  sifter.dmMatchFactor = engine.dmMatchFactor;
+  sifter.harmonics = engine.harmonics;
+  // The engine's candidates are in S/N order, with ties in the order they arrived, so they can be numbered in that order
+  sifter.ccl = engine.ccl;
+  sifter.groupOf.assign(sifter.ccl.snr.size(), -1);
+  sifter.groups.clear();
+  sifter.byPeriod.clear();
+  sifter.primariesByPeriod.clear();
+  for (size_t cand = 0; cand < sifter.ccl.snr.size(); cand++) {
+    sifter.byPeriod.emplace(sifter.ccl.period[cand], cand);
+  }
+  for (size_t group = 0; group < engine.groupStarts.size(); group++) {
+    const size_t groupEnd = group + 1 < engine.groupStarts.size() ? engine.groupStarts[group + 1] : engine.scl.size();
+    sifter.groups.push_back({std::vector<int>(engine.scl.begin() + engine.groupStarts[group], engine.scl.begin() + groupEnd), true});
+    for (int member : sifter.groups.back().members) {
+      sifter.groupOf[member] = group;
+    }
+    sifter.primariesByPeriod.emplace(sifter.ccl.period[sifter.groups.back().members[0]], sifter.groups.back().members[0]);
+  }
+}
+
+// Write every live group as an addition to the SCL
+inline void writeSCLAdditions(const IncrementalSift &sifter, std::ostream &diffs) {
+  for (size_t group = 0; group < sifter.groups.size(); group++) {
+    if (sifter.groups[group].alive) {
+      diffs << "+ " << group << " ";
+      writeSCLGroup(diffs, sifter.ccl, sifter.groups[group].members.data(), sifter.groups[group].members.data() + sifter.groups[group].members.size());
+      diffs << "\n";
+    }
+  }
+}
+
+// Add a candidate, regroup the candidates it affects, and write the changes to the SCL
+inline void addCandidate(IncrementalSift &sifter, double snr, double period, double dm, std::ostream &diffs) {
+
+  const int newCand = sifter.ccl.snr.size();
+  const int numOldGroups = sifter.groups.size();
+  std::vector<int> matches, changedGroups;
+
+  sifter.ccl.snr.push_back(snr);
+  sifter.ccl.period.push_back(period);
+  sifter.ccl.dm.push_back(dm);
+  sifter.groupOf.push_back(-1);
+  sifter.byPeriod.emplace(period, newCand);
+
+  // Candidates waiting to be placed in a group, taken highest S/N first
+  auto placedAfter = [&sifter](int i, int j) { return outranks(sifter, j, i); };
+  std::priority_queue<int, std::vector<int>, decltype(placedAfter)> unplaced(placedAfter);
+  unplaced.push(newCand);
+
+  while (!unplaced.empty()) {
+
+    const int cand = unplaced.top();
+    unplaced.pop();
+
+    // Join the highest S/N primary that outranks this candidate and that it is a harmonic of
+    int bestPrimary = -1;
+    findIndexedRelated(sifter, sifter.primariesByPeriod, cand, false, matches);
+    for (int primary : matches) {
+      if (outranks(sifter, primary, cand) && (bestPrimary < 0 || outranks(sifter, primary, bestPrimary))) {
+        bestPrimary = primary;
+      }
+    }
+    if (bestPrimary >= 0) {
+      const int group = sifter.groupOf[bestPrimary];
+      std::vector<int> &members = sifter.groups[group].members;
+      members.insert(std::upper_bound(members.begin(), members.end(), cand, [&sifter](int i, int j) { return outranks(sifter, i, j); }), cand);
+      sifter.groupOf[cand] = group;
+      changedGroups.push_back(group);
+      continue;
+    }
+
+    // Otherwise it starts a group of its own
+    const int newGroup = sifter.groups.size();
+    sifter.groups.push_back({std::vector<int>(1, cand), true});
+    sifter.groupOf[cand] = newGroup;
+    sifter.primariesByPeriod.emplace(sifter.ccl.period[cand], cand);
+    changedGroups.push_back(newGroup);
+
+    // Break up every group with a lower S/N primary that holds one of its harmonics; their members are placed again, and the harmonics will join this group
+    findIndexedRelated(sifter, sifter.byPeriod, cand, true, matches);
+    for (int related : matches) {
+      const int group = sifter.groupOf[related];
+      if (group < 0 || group == newGroup || !outranks(sifter, cand, sifter.groups[group].members[0])) {
+        continue;
+      }
+      removePrimary(sifter, sifter.groups[group].members[0]);
+      for (int member : sifter.groups[group].members) {
+        sifter.groupOf[member] = -1;
+        unplaced.push(member);
+      }
+      sifter.groups[group].members.clear();
+      sifter.groups[group].alive = false;
+      changedGroups.push_back(group);
+    }
+
+  }
+
+  // Report the groups that are gone, then the new and changed groups; groups made and broken up again while placing this candidate are left out
+  std::sort(changedGroups.begin(), changedGroups.end());
+  changedGroups.erase(std::unique(changedGroups.begin(), changedGroups.end()), changedGroups.end());
+  for (int group : changedGroups) {
+    if (group < numOldGroups && !sifter.groups[group].alive) {
+      diffs << "- " << group << "\n";
+    }
+  }
+  for (int group : changedGroups) {
+    if (sifter.groups[group].alive) {
+      diffs << (group < numOldGroups ? "~ " : "+ ") << group << " ";
+      writeSCLGroup(diffs, sifter.ccl, sifter.groups[group].members.data(), sifter.groups[group].members.data() + sifter.groups[group].members.size());
+      diffs << "\n";
+    }
+  }
+
+}
+
+// Read candidates as lines of a CCL from 'input' until it ends, adding each and writing the changes to the SCL to 'diffs'
+// The diffs are flushed whenever there is no more input waiting, so a reader sees the changes as soon as a batch of candidates has been added
+// If 'known' is given, candidates matching known sources are listed in 'knownFile' and, if 'dropKnown' is set, not added
+inline void siftIncrementally(IncrementalSift &sifter, std::istream &input, std::ostream &diffs, const KnownSourceIndex *known, bool dropKnown, std::ostream &knownFile) {
+  std::string line;
+  candidateList lineCandidates;
+  while (std::getline(input, line)) {
+    lineCandidates.snr.clear();
+    lineCandidates.period.clear();
+    lineCandidates.dm.clear();
+    parseCCL(line.data(), line.data() + line.size(), lineCandidates);
+    if (known != NULL) {
+      filterKnownSources(*known, lineCandidates, dropKnown, knownFile);
+    }
+    for (size_t cand = 0; cand < lineCandidates.snr.size(); cand++) {
+      addCandidate(sifter, lineCandidates.snr[cand], lineCandidates.period[cand], lineCandidates.dm[cand], diffs);
+    }
+    if (input.rdbuf()->in_avail() <= 0) {
+      diffs.flush();
+      knownFile.flush();
+    }
+  }
+  diffs.flush();
+}
+
+// Everything a front-end (sift or strongSift) does: read its options and the CCL, sift it with its harmonic policy, and write scl.txt
+inline int siftMain(int argc, char *argv[], harmonicPolicy policy, void (*usage)()) {
+
+  int arg, maxHarm = defaultMaxHarm, numThreads = 0, incremental = 0, dropKnown = 1;
+  double periodMatchFactor = 0.001, dmMatchFactor = 0.1;
+  std::vector<const char*> fileNames;
+  const char *catalogFileName = NULL;
+  std::ofstream outfile, knownFile;
+  candidateList ccl;
+  SiftEngine engine;
+  IncrementalSift sifter;
+  KnownSourceIndex known;
+
+  while ((arg = getopt(argc, argv, "d:f:H:hij:k:Kp:")) != -1) {
+    switch (arg) {
+
+      // A text file which lists parameters for candidates; any number can be given
+      case 'f':
+        fileNames.push_back(optarg);
+        break;
+
+      case 'd':
+        dmMatchFactor = atof(optarg);
+        if (dmMatchFactor < 0) {
+          std::cout << "dmMatchFactor must be positive!" << std::endl << "Defaulting to 0.1!" << std::endl;
+          dmMatchFactor = 0.1;
+        }
+        break;
+
+      case 'H':
+        maxHarm = atoi(optarg);
+        if (maxHarm < 1) {
+          std::cout << "Number of trial harmonic ratios must be at least 1!" << std::endl << "Defaulting to 8 harmonics!" << std::endl;
+          maxHarm = defaultMaxHarm;
+        }
+        break;
+
+      case 'i':
+        incremental = 1;
+        break;
+
+      case 'j':
+        numThreads = atoi(optarg);
+        break;
+
+      case 'k':
+        catalogFileName = optarg;
+        break;
+
+      case 'K':
+        dropKnown = 0;
+        break;
+
+      case 'p':
+        periodMatchFactor = atof(optarg);
+        if (periodMatchFactor < 0) {
+          std::cout << "periodMatchFactor must be positive!" << std::endl << "Defaulting to 0.001!" << std::endl;
+          periodMatchFactor = 0.001;
+        }
+        break;
+
+      case 'h':
+        usage();
+        exit(0);
+
+      default:
+        return 0;
+        break;
+
+    }
+  }
+
+  // CCL files can also be listed after the options
+  for (int i = optind; i < argc; i++) {
+    fileNames.push_back(argv[i]);
+  }
+
+  // Check if the user has failed to specify the -f flag; in incremental mode, all of the candidates can come from the standard input
+  if (fileNames.size() == 0 && !incremental) {
+    std::cout << "You must input a CCL file with the -f flag!" << std::endl;
+    usage();
+    exit(0);
+  }
+
+  setupSiftEngine(engine, policy, maxHarm, periodMatchFactor, dmMatchFactor, numThreads);
+
+  // Read the candidates in all of the files, as one list
+  const int unreadFile = readCCLFiles(fileNames, ccl, engine.numThreads);
+  if (unreadFile >= 0) {
+    std::cout << "Error opening file " << fileNames[unreadFile] << " to read!" << std::endl;
+    usage();
+    exit(0);
+  }
+
+  // List the candidates that are harmonics of known sources, and unless they are only being tagged, take them out before sifting
+  if (catalogFileName != NULL) {
+    if (!readKnownSources(catalogFileName, known)) {
+      std::cout << "Error reading known source catalog " << catalogFileName << "!" << std::endl;
+      exit(0);
+    }
+    buildKnownSourceIndex(known, engine.harmonics, periodMatchFactor, dmMatchFactor);
+    knownFile.open("known.txt");
+    const size_t numMatches = filterKnownSources(known, ccl, dropKnown, knownFile);
+    if (!incremental) {
+      std::cout << numMatches << " candidates match known sources; listed in known.txt" << (dropKnown ? " and taken out" : "") << std::endl;
+    }
+  }
+
+  siftCandidates(engine, ccl);
+
+  // In incremental mode, start from the SCL of the files, then add the candidates from the standard input, writing the changes to the standard output
+  if (incremental) {
+    setupIncrementalSift(sifter, engine);
+    writeSCLAdditions(sifter, std::cout);
+    siftIncrementally(sifter, std::cin, std::cout, catalogFileName != NULL ? &known : NULL, dropKnown, knownFile);
+    return 0;
+  }
+
+  // Write the sifted candidates to the output file. The name 'scl' stands for 'Sifted Candidate List'
+  outfile.open("scl.txt");
+  writeSCL(engine, outfile);
+  outfile.close();
+
+  return 0;
+
+}
+
+#endif